@@ -0,0 +1,396 @@
+/**
+ * @file bench.cpp
+ * @author Ilya Kudryashov (kudriashov.it@phystech.edu)
+ * @brief Benchmark of reading, sorting and writing phases on synthetic corpora.
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <clocale>
+
+#include "../lib/util/dbg/debug.h"
+#include "../lib/util/argparser.h"
+#include "../lib/txtproc.h"
+#include "../lib/sorting.h"
+#include "../lib/utf8.h"
+
+/**
+ * @brief Function generating single line of the corpus.
+ *
+ * @param[out] line buffer for at least MAX_GENERATED_LINE_LENGTH characters
+ * @return size_t number of generated characters
+ */
+typedef size_t (*line_generator_t)(wchar_t* line);
+
+/**
+ * @brief Kind of synthetic text.
+ *
+ * @param name name of the corpus in the results
+ * @param generator function generating its lines
+ */
+struct Corpus {
+    const char* name;
+    line_generator_t generator;
+};
+
+/**
+ * @brief Timings of repeated runs of a single phase.
+ *
+ * @param best shortest run in seconds
+ * @param median median run in seconds
+ */
+struct Timing {
+    double best;
+    double median;
+};
+
+/**
+ * @brief Get current time of the monotonic clock in seconds.
+ */
+static double current_time();
+
+/**
+ * @brief Get next pseudo-random number (xorshift, the same sequence on every run).
+ */
+static uint64_t next_random();
+
+/**
+ * @brief Write corpus of approximately corpus_size bytes into the file.
+ *
+ * @return bool true on success
+ */
+static bool generate_corpus(const Corpus* corpus, const char* file_name, size_t corpus_size);
+
+/**
+ * @brief Run the phase several times and collect its timings.
+ *
+ * @param prepare function called before every run outside of the measured interval
+ * @param phase function to measure
+ * @return Timing best and median times
+ */
+template <typename Prepare, typename Phase>
+static Timing measure(Prepare prepare, Phase phase);
+
+/**
+ * @brief Print row of the results table.
+ */
+static void print_row(const char* corpus, size_t size, int lines, const char* phase,
+                      const char* engine, const char* comparator, Timing timing);
+
+/**
+ * @brief Benchmark all phases on the file.
+ */
+static void bench_file(const char* corpus_name, const char* file_name);
+
+static size_t ascii_line(wchar_t* line);
+static size_t cyrillic_line(wchar_t* line);
+static size_t punctuation_line(wchar_t* line);
+static size_t duplicate_line(wchar_t* line);
+
+static const size_t MAX_GENERATED_LINE_LENGTH = 128;
+static const int DUPLICATE_POOL_SIZE = 64;
+static const int MAX_REPEAT_COUNT = 101;
+
+static const int NUMBER_OF_CORPORA = 4;
+static const Corpus CORPORA[NUMBER_OF_CORPORA] = {
+    {"ascii",      ascii_line},
+    {"cyrillic",   cyrillic_line},
+    {"punctuation", punctuation_line},
+    {"duplicate",  duplicate_line},
+};
+
+static const char BENCH_OUTPUT_NAME[] = "bench_output.txt";
+
+static const size_t MAX_NAME_LENGTH = 1024;
+static char corpus_selection[MAX_NAME_LENGTH] = "all";
+static char text_source_name[MAX_NAME_LENGTH] = "";
+
+static int corpus_kilobytes = 1024;
+static int repeat_count = 5;
+
+static const int NUMBER_OF_TAGS = 4;
+static const struct ActionTag LINE_TAGS[NUMBER_OF_TAGS] = {
+    {
+        .name = {'X', ""},
+        .action = {
+            .parameters = (void*[]) {&corpus_selection},
+            .parameters_length = 1,
+            .function = edit_string,
+        },
+        .description = "selects corpus: ascii, cyrillic, punctuation, duplicate or all (default)."
+    },
+    {
+        .name = {'S', ""},
+        .action = {
+            .parameters = (void*[]) {&corpus_kilobytes},
+            .parameters_length = 1,
+            .function = edit_int,
+        },
+        .description = "sets size of generated corpora in kilobytes (1024 by default)."
+    },
+    {
+        .name = {'C', ""},
+        .action = {
+            .parameters = (void*[]) {&repeat_count},
+            .parameters_length = 1,
+            .function = edit_int,
+        },
+        .description = "sets the number of runs of every phase (5 by default)."
+    },
+    {
+        .name = {'R', ""},
+        .action = {
+            .parameters = (void*[]) {&text_source_name},
+            .parameters_length = 1,
+            .function = edit_string,
+        },
+        .description = "benchmarks specified file instead of generated corpora."
+    },
+};
+
+int main(const int argc, const char** argv) {
+    setlocale(LC_ALL, "C.UTF-8");
+    errno = 0;
+
+    parse_args(argc, argv, NUMBER_OF_TAGS, LINE_TAGS);
+    log_init("bench.log", ABSOLUTE_IMPORTANCE, &errno);
+
+    if (repeat_count < 1) repeat_count = 1;
+    if (repeat_count > MAX_REPEAT_COUNT) repeat_count = MAX_REPEAT_COUNT;
+    if (corpus_kilobytes < 1) corpus_kilobytes = 1;
+
+    printf("corpus\tbytes\tlines\tphase\tengine\tcomparator\tbest_s\tmedian_s\n");
+
+    if (*text_source_name) {
+        bench_file(text_source_name, text_source_name);
+    } else {
+        for (int corpus_id = 0; corpus_id < NUMBER_OF_CORPORA; corpus_id++) {
+            const Corpus* corpus = &CORPORA[corpus_id];
+            if (strcmp(corpus_selection, "all") && strcmp(corpus_selection, corpus->name)) continue;
+
+            char file_name[MAX_NAME_LENGTH] = "";
+            snprintf(file_name, sizeof(file_name), "bench_%s.txt", corpus->name);
+
+            if (!generate_corpus(corpus, file_name, (size_t)corpus_kilobytes << 10)) {
+                fprintf(stderr, "Failed to generate corpus %s.\n", corpus->name);
+                return EXIT_FAILURE;
+            }
+
+            bench_file(corpus->name, file_name);
+            remove(file_name);
+        }
+    }
+
+    remove(BENCH_OUTPUT_NAME);
+    log_close();
+
+    return EXIT_SUCCESS;
+}
+
+static double current_time() {
+    struct timespec moment = {};
+    clock_gettime(CLOCK_MONOTONIC, &moment);
+    return (double)moment.tv_sec + (double)moment.tv_nsec * 1e-9;
+}
+
+static uint64_t next_random() {
+    static uint64_t state = 0x9E3779B97F4A7C15ull;
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+/**
+ * @brief Generate line of words made of characters from the alphabet separated by the separators.
+ */
+static size_t word_line(wchar_t* line, const wchar_t* alphabet, size_t alphabet_size,
+                        const wchar_t* separators, size_t separators_size) {
+    size_t length = next_random() % (MAX_GENERATED_LINE_LENGTH - 8);
+    for (size_t char_id = 0; char_id < length; char_id++) {
+        if (next_random() % 6 == 0) line[char_id] = separators[next_random() % separators_size];
+        else line[char_id] = alphabet[next_random() % alphabet_size];
+    }
+    return length;
+}
+
+static size_t ascii_line(wchar_t* line) {
+    static const wchar_t ALPHABET[] = L"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    static const wchar_t SEPARATORS[] = L"     ,.";
+    return word_line(line, ALPHABET, sizeof(ALPHABET) / sizeof(*ALPHABET) - 1,
+                     SEPARATORS, sizeof(SEPARATORS) / sizeof(*SEPARATORS) - 1);
+}
+
+static size_t cyrillic_line(wchar_t* line) {
+    static wchar_t alphabet[64] = {};
+    if (!*alphabet) {
+        for (int letter_id = 0; letter_id < 64; letter_id++) alphabet[letter_id] = 0x0410 + letter_id;
+    }
+    static const wchar_t SEPARATORS[] = L"     ,.";
+    return word_line(line, alphabet, sizeof(alphabet) / sizeof(*alphabet),
+                     SEPARATORS, sizeof(SEPARATORS) / sizeof(*SEPARATORS) - 1);
+}
+
+static size_t punctuation_line(wchar_t* line) {
+    static const wchar_t ALPHABET[] = L"abcdefghijklmnopqrstuvwxyz0123456789абвгдеж";
+    static const wchar_t SEPARATORS[] = L" ,.;:!?-\"'()[]«»—…";
+    size_t length = next_random() % (MAX_GENERATED_LINE_LENGTH - 8);
+    for (size_t char_id = 0; char_id < length; char_id++) {
+        if (next_random() % 2) line[char_id] = SEPARATORS[next_random() % (sizeof(SEPARATORS) / sizeof(*SEPARATORS) - 1)];
+        else line[char_id] = ALPHABET[next_random() % (sizeof(ALPHABET) / sizeof(*ALPHABET) - 1)];
+    }
+    return length;
+}
+
+static size_t duplicate_line(wchar_t* line) {
+    static wchar_t pool[DUPLICATE_POOL_SIZE][MAX_GENERATED_LINE_LENGTH] = {};
+    static size_t pool_lengths[DUPLICATE_POOL_SIZE] = {};
+    static bool pool_ready = false;
+    if (!pool_ready) {
+        for (int pool_id = 0; pool_id < DUPLICATE_POOL_SIZE; pool_id++) {
+            pool_lengths[pool_id] = (pool_id % 2 ? ascii_line : cyrillic_line)(pool[pool_id]);
+        }
+        pool_ready = true;
+    }
+
+    int pool_id = next_random() % DUPLICATE_POOL_SIZE;
+    memcpy(line, pool[pool_id], pool_lengths[pool_id] * sizeof(*line));
+    return pool_lengths[pool_id];
+}
+
+static bool generate_corpus(const Corpus* corpus, const char* file_name, size_t corpus_size) {
+    FILE* file = fopen(file_name, "w");
+    if (!file) return false;
+
+    wchar_t line[MAX_GENERATED_LINE_LENGTH] = L"";
+    char bytes[MAX_GENERATED_LINE_LENGTH * UTF8_MAX_SEQUENCE_LENGTH + 1] = "";
+
+    bool success = true;
+    for (size_t written = 0; written < corpus_size && success;) {
+        size_t byte_count = utf8_encode(line, corpus->generator(line), bytes);
+        bytes[byte_count++] = '\n';
+        success = fwrite(bytes, 1, byte_count, file) == byte_count;
+        written += byte_count;
+    }
+
+    if (fclose(file)) success = false;
+    return success;
+}
+
+static int compare_timings(const void* timing_a, const void* timing_b) {
+    double difference = *(const double*)timing_a - *(const double*)timing_b;
+    return (difference > 0) - (difference < 0);
+}
+
+template <typename Prepare, typename Phase>
+static Timing measure(Prepare prepare, Phase phase) {
+    double timings[MAX_REPEAT_COUNT] = {};
+    for (int run_id = 0; run_id < repeat_count; run_id++) {
+        prepare();
+
+        double start = current_time();
+        phase();
+        timings[run_id] = current_time() - start;
+    }
+
+    qsort(timings, repeat_count, sizeof(*timings), compare_timings);
+    return {timings[0], timings[repeat_count / 2]};
+}
+
+static void print_row(const char* corpus, size_t size, int lines, const char* phase,
+                      const char* engine, const char* comparator, Timing timing) {
+    printf("%s\t%zu\t%d\t%s\t%s\t%s\t%.6f\t%.6f\n", corpus, size, lines, phase, engine, comparator,
+           timing.best, timing.median);
+    fflush(stdout);
+}
+
+static void bench_file(const char* corpus_name, const char* file_name) {
+    Charline* lines = NULL;
+    wchar_t* buffer = NULL;
+    int length = read_file(file_name, &lines, &buffer, &errno);
+    if (length == READING_FAILURE) {
+        fprintf(stderr, "Failed to read file %s.\n", file_name);
+        return;
+    }
+
+    FILE* file = fopen(file_name, "r");
+    fseek(file, 0, SEEK_END);
+    size_t size = ftell(file);
+    fclose(file);
+
+    auto nothing = []() {};
+
+    print_row(corpus_name, size, length, "read", "read_file", "-", measure(nothing, [&]() {
+        Charline* read_lines = NULL;
+        wchar_t* read_buffer = NULL;
+        read_file(file_name, &read_lines, &read_buffer, &errno);
+        free(read_lines);
+        free(read_buffer);
+    }));
+
+    Charline* copy = (Charline*)calloc(length, sizeof(*copy));
+    if (!copy) return;
+
+    auto restore = [&]() { memcpy(copy, lines, length * sizeof(*lines)); };
+
+    static const struct {
+        const char* name;
+        int (*comparator)(const void*, const void*);
+    } COMPARATORS[] = {
+        {"compare_lines",         compare_lines},
+        {"compare_reverse_lines", compare_reverse_lines},
+    };
+
+    for (size_t comparator_id = 0; comparator_id < sizeof(COMPARATORS) / sizeof(*COMPARATORS); comparator_id++) {
+        int (*comparator)(const void*, const void*) = COMPARATORS[comparator_id].comparator;
+        const char* name = COMPARATORS[comparator_id].name;
+
+        print_row(corpus_name, size, length, "sort", "qsort", name, measure(restore, [&]() {
+            qsort(copy, length, sizeof(*copy), comparator); }));
+        print_row(corpus_name, size, length, "sort", "msort", name, measure(restore, [&]() {
+            msort(copy, length, sizeof(*copy), comparator); }));
+    }
+
+    for (int reverse = 0; reverse <= 1; reverse++) {
+        const char* name = reverse ? "reverse_keys" : "keys";
+        wchar_t* keys = NULL;
+
+        print_row(corpus_name, size, length, "keys", "build_keys", name, measure(
+            [&]() { restore(); free(keys); keys = NULL; },
+            [&]() { keys = build_keys(copy, length, reverse, NULL, &errno); }));
+        if (!keys) break;
+
+        //* Keys stay valid for any permutation of the copy, so every run only needs the original order.
+        Charline* keyed = copy_lines(copy, length, &errno);
+        if (!keyed) {
+            free(keys);
+            break;
+        }
+        auto restore_keyed = [&]() { memcpy(copy, keyed, length * sizeof(*keyed)); };
+
+        print_row(corpus_name, size, length, "sort", "qsort", name, measure(restore_keyed, [&]() {
+            qsort(copy, length, sizeof(*copy), compare_keys); }));
+        print_row(corpus_name, size, length, "sort", "msort", name, measure(restore_keyed, [&]() {
+            msort(copy, length, CompareKeys(), NULL, &errno); }));
+        print_row(corpus_name, size, length, "sort", "mkqsort", name, measure(restore_keyed, [&]() {
+            mkqsort(copy, length, sizeof(*copy), get_line_key, NULL, &errno); }));
+
+        free(keyed);
+        free(keys);
+    }
+
+    print_row(corpus_name, size, length, "write", "write_file", "-", measure(nothing, [&]() {
+        write_file(BENCH_OUTPUT_NAME, lines, length, &errno); }));
+
+    free(copy);
+    free(lines);
+    free(buffer);
+}
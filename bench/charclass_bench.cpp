@@ -0,0 +1,192 @@
+/**
+ * @file charclass_bench.cpp
+ * @author Ilya Kudryashov (kudriashov.it@phystech.edu)
+ * @brief Benchmark of the compile-time character table against iswalpha() and iswdigit().
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <clocale>
+#include <cwctype>
+
+#include "../lib/util/dbg/debug.h"
+#include "../lib/util/argparser.h"
+#include "../lib/txtproc.h"
+#include "../lib/charclass.h"
+
+/**
+ * @brief Get current time of the monotonic clock in seconds.
+ */
+static double current_time();
+
+/**
+ * @brief Run the function several times and return the best time.
+ *
+ * @param run function to measure
+ * @return double best time in seconds
+ */
+template <typename Run>
+static double measure(Run run);
+
+/**
+ * @brief Classification wlinecmp() used before the table.
+ */
+static inline int libc_sortable(const wchar_t character) {
+    return iswalpha(character) || iswdigit(character);
+}
+
+/**
+ * @brief wlinecmp() with libc classification.
+ */
+static int libc_wlinecmp(const wchar_t* start_a, const wchar_t* end_a, const wchar_t* start_b, const wchar_t* end_b);
+
+static int libc_compare_lines(const void* void_a, const void* void_b);
+static int libc_compare_reverse_lines(const void* void_a, const void* void_b);
+
+static const size_t MAX_SOURCE_NAME_LENGTH = 1024;
+static char text_source_name[MAX_SOURCE_NAME_LENGTH] = "onegin.txt";
+
+static int repeat_count = 5;
+
+static const int NUMBER_OF_TAGS = 2;
+static const struct ActionTag LINE_TAGS[NUMBER_OF_TAGS] = {
+    {
+        .name = {'R', ""},
+        .action = {
+            .parameters = (void*[]) {&text_source_name},
+            .parameters_length = 1,
+            .function = edit_string,
+        },
+        .description = "sets the file to classify and sort."
+    },
+    {
+        .name = {'C', ""},
+        .action = {
+            .parameters = (void*[]) {&repeat_count},
+            .parameters_length = 1,
+            .function = edit_int,
+        },
+        .description = "sets the number of runs of every measurement (best one is reported)."
+    },
+};
+
+int main(const int argc, const char** argv) {
+    setlocale(LC_ALL, "C.UTF-8");
+    errno = 0;
+
+    parse_args(argc, argv, NUMBER_OF_TAGS, LINE_TAGS);
+    log_init("charclass_bench.log", ABSOLUTE_IMPORTANCE, &errno);
+
+    Charline* lines = NULL;
+    wchar_t* buffer = NULL;
+    int length = read_file(text_source_name, &lines, &buffer, &errno);
+    if (length == READING_FAILURE) {
+        printf("Failed to read file %s.\n", text_source_name);
+        return EXIT_FAILURE;
+    }
+
+    Charline* copy = (Charline*)calloc(length, sizeof(*copy));
+    if (!copy) return EXIT_FAILURE;
+
+    const wchar_t* text_begin = lines[0].begin();
+    const wchar_t* text_end = lines[length - 1].end();
+
+    volatile size_t sortable_count = 0;
+
+    printf("%-24s %-10s %12s\n", "measurement", "classes", "seconds");
+
+    printf("%-24s %-10s %12.6f\n", "classify", "libc", measure([&]() {
+        size_t count = 0;
+        for (const wchar_t* id = text_begin; id < text_end; id++) count += libc_sortable(*id);
+        sortable_count = count; }));
+    printf("%-24s %-10s %12.6f\n", "classify", "table", measure([&]() {
+        size_t count = 0;
+        for (const wchar_t* id = text_begin; id < text_end; id++) count += is_sortable_character(*id);
+        sortable_count = count; }));
+
+    printf("%-24s %-10s %12.6f\n", "compare_lines", "libc", measure([&]() {
+        memcpy(copy, lines, length * sizeof(*lines));
+        qsort(copy, length, sizeof(*copy), libc_compare_lines); }));
+    printf("%-24s %-10s %12.6f\n", "compare_lines", "table", measure([&]() {
+        memcpy(copy, lines, length * sizeof(*lines));
+        qsort(copy, length, sizeof(*copy), compare_lines); }));
+
+    printf("%-24s %-10s %12.6f\n", "compare_reverse_lines", "libc", measure([&]() {
+        memcpy(copy, lines, length * sizeof(*lines));
+        qsort(copy, length, sizeof(*copy), libc_compare_reverse_lines); }));
+    printf("%-24s %-10s %12.6f\n", "compare_reverse_lines", "table", measure([&]() {
+        memcpy(copy, lines, length * sizeof(*lines));
+        qsort(copy, length, sizeof(*copy), compare_reverse_lines); }));
+
+    free(copy);
+    free(lines);
+    free(buffer);
+    log_close();
+
+    return EXIT_SUCCESS;
+}
+
+static double current_time() {
+    struct timespec moment = {};
+    clock_gettime(CLOCK_MONOTONIC, &moment);
+    return (double)moment.tv_sec + (double)moment.tv_nsec * 1e-9;
+}
+
+template <typename Run>
+static double measure(Run run) {
+    double best_time = -1;
+    for (int run_id = 0; run_id < repeat_count; run_id++) {
+        double start = current_time();
+        run();
+        double elapsed = current_time() - start;
+
+        if (best_time < 0 || elapsed < best_time) best_time = elapsed;
+    }
+    return best_time;
+}
+
+static inline int in_bounds(const void * const value, const void * const left, const void * const right) {
+    if (right < left) {
+        return right <= value && value <= left;
+    }
+    return left <= value && value <= right;
+}
+
+static int libc_wlinecmp(const wchar_t* start_a, const wchar_t* end_a, const wchar_t* start_b, const wchar_t* end_b) {
+    const wchar_t *id_a = start_a, *id_b = start_b;
+    int step_a = (end_a > start_a) ? 1 : -1;
+    int step_b = (end_b > start_b) ? 1 : -1;
+
+    while (in_bounds(id_a, start_a, end_a) && in_bounds(id_b, start_b, end_b)) {
+        while (!libc_sortable(*id_a) && in_bounds(id_a, start_a, end_a)) id_a += step_a;
+        while (!libc_sortable(*id_b) && in_bounds(id_b, start_b, end_b)) id_b += step_b;
+
+        if (!in_bounds(id_a, start_a, end_a) || !in_bounds(id_b, start_b, end_b)) break;
+
+        int difference = *id_a - *id_b;
+        if (difference) return difference;
+
+        id_a += step_a; id_b += step_b;
+    }
+
+    return in_bounds(id_a, start_a, end_a) - in_bounds(id_b, start_b, end_b);
+}
+
+static int libc_compare_lines(const void* void_a, const void* void_b) {
+    const Charline* a = (const Charline*)void_a;
+    const Charline* b = (const Charline*)void_b;
+    return libc_wlinecmp(a->begin(), a->end() - 1, b->begin(), b->end() - 1);
+}
+
+static int libc_compare_reverse_lines(const void* void_a, const void* void_b) {
+    const Charline* a = (const Charline*)void_a;
+    const Charline* b = (const Charline*)void_b;
+    return libc_wlinecmp(a->end() - 1, a->begin(), b->end() - 1, b->begin());
+}
@@ -0,0 +1,137 @@
+/**
+ * @file msort_bench.cpp
+ * @author Ilya Kudryashov (kudriashov.it@phystech.edu)
+ * @brief Benchmark of the typed msort() against the void* one.
+ * @version 0.1
+ * @date 2026-10-17
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <clocale>
+
+#include "../lib/util/dbg/debug.h"
+#include "../lib/util/argparser.h"
+#include "../lib/txtproc.h"
+#include "../lib/sorting.h"
+
+/**
+ * @brief Get current time of the monotonic clock in seconds.
+ */
+static double current_time();
+
+/**
+ * @brief Sort copies of the lines several times and return the best time.
+ * 
+ * @param lines lines to sort
+ * @param copy buffer for the copy of the lines
+ * @param length number of lines
+ * @param sort function sorting the copy
+ * @return double best time in seconds
+ */
+template <typename Sort>
+static double measure(const Charline* lines, Charline* copy, int length, Sort sort);
+
+static const size_t MAX_SOURCE_NAME_LENGTH = 1024;
+static char text_source_name[MAX_SOURCE_NAME_LENGTH] = "onegin.txt";
+
+static int repeat_count = 5;
+
+static const int NUMBER_OF_TAGS = 2;
+static const struct ActionTag LINE_TAGS[NUMBER_OF_TAGS] = {
+    {
+        .name = {'R', ""}, 
+        .action = {
+            .parameters = (void*[]) {&text_source_name},
+            .parameters_length = 1, 
+            .function = edit_string,
+        },
+        .description = "sets the file to sort."
+    },
+    {
+        .name = {'C', ""}, 
+        .action = {
+            .parameters = (void*[]) {&repeat_count},
+            .parameters_length = 1, 
+            .function = edit_int,
+        },
+        .description = "sets the number of runs of every sort (best one is reported)."
+    },
+};
+
+int main(const int argc, const char** argv) {
+    setlocale(LC_ALL, "C.UTF-8");
+    errno = 0;
+
+    parse_args(argc, argv, NUMBER_OF_TAGS, LINE_TAGS);
+    log_init("msort_bench.log", ABSOLUTE_IMPORTANCE, &errno);
+
+    Charline* lines = NULL;
+    wchar_t* buffer = NULL;
+    int length = read_file(text_source_name, &lines, &buffer, &errno);
+    if (length == READING_FAILURE) {
+        printf("Failed to read file %s.\n", text_source_name);
+        return EXIT_FAILURE;
+    }
+
+    wchar_t* keys = build_keys(lines, length, false, NULL, &errno);
+    Charline* copy = (Charline*)calloc(length, sizeof(*copy));
+    if (!keys || !copy) return EXIT_FAILURE;
+
+    printf("%-24s %-10s %12s\n", "comparator", "msort", "seconds");
+
+    printf("%-24s %-10s %12.6f\n", "compare_lines", "void*", 
+           measure(lines, copy, length, [](Charline* array, int size) { 
+               msort(array, size, sizeof(*array), compare_lines); }));
+    printf("%-24s %-10s %12.6f\n", "compare_lines", "typed", 
+           measure(lines, copy, length, [](Charline* array, int size) { 
+               msort(array, size, CompareLines()); }));
+
+    printf("%-24s %-10s %12.6f\n", "compare_reverse_lines", "void*", 
+           measure(lines, copy, length, [](Charline* array, int size) { 
+               msort(array, size, sizeof(*array), compare_reverse_lines); }));
+    printf("%-24s %-10s %12.6f\n", "compare_reverse_lines", "typed", 
+           measure(lines, copy, length, [](Charline* array, int size) { 
+               msort(array, size, CompareReverseLines()); }));
+
+    printf("%-24s %-10s %12.6f\n", "compare_keys", "void*", 
+           measure(lines, copy, length, [](Charline* array, int size) { 
+               msort(array, size, sizeof(*array), compare_keys); }));
+    printf("%-24s %-10s %12.6f\n", "compare_keys", "typed", 
+           measure(lines, copy, length, [](Charline* array, int size) { 
+               msort(array, size, CompareKeys()); }));
+
+    free(copy);
+    free(keys);
+    free(lines);
+    free(buffer);
+    log_close();
+
+    return EXIT_SUCCESS;
+}
+
+static double current_time() {
+    struct timespec moment = {};
+    clock_gettime(CLOCK_MONOTONIC, &moment);
+    return (double)moment.tv_sec + (double)moment.tv_nsec * 1e-9;
+}
+
+template <typename Sort>
+static double measure(const Charline* lines, Charline* copy, int length, Sort sort) {
+    double best_time = -1;
+    for (int run_id = 0; run_id < repeat_count; run_id++) {
+        memcpy(copy, lines, length * sizeof(*lines));
+
+        double start = current_time();
+        sort(copy, length);
+        double elapsed = current_time() - start;
+
+        if (best_time < 0 || elapsed < best_time) best_time = elapsed;
+    }
+    return best_time;
+}
@@ -0,0 +1,379 @@
+/**
+ * @file query_load.cpp
+ * @author Ilya Kudryashov (kudriashov.it@phystech.edu)
+ * @brief Load generator measuring latency and throughput of the query server (see -S of the main program).
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <clocale>
+
+#include "../lib/util/dbg/debug.h"
+#include "../lib/util/argparser.h"
+#include "../lib/txtproc.h"
+
+/**
+ * @brief Buffered reader of the answers.
+ *
+ * @param fd socket to read from
+ * @param data buffer
+ * @param start first unread byte
+ * @param end end of the read bytes
+ */
+struct AnswerReader {
+    int fd = -1;
+    char data[1 << 16] = "";
+    size_t start = 0;
+    size_t end = 0;
+};
+
+/**
+ * @brief Client thread with its share of the requests.
+ *
+ * @param id number of the client
+ * @param latencies latency of every request in seconds
+ * @param request_count number of requests to send
+ * @param matched_lines total number of lines matched by the requests
+ * @param received_lines total number of lines received
+ * @param failed set if the connection broke
+ */
+struct LoadClient {
+    int id = 0;
+    double* latencies = NULL;
+    int request_count = 0;
+    long matched_lines = 0;
+    long received_lines = 0;
+    bool failed = false;
+};
+
+/**
+ * @brief Get current time of the monotonic clock in seconds.
+ */
+static double current_time();
+
+/**
+ * @brief Build requests from the first and the last words of the lines of the corpus.
+ *
+ * @param source mapped corpus
+ * @param request_list array to put requests into (allocated)
+ * @param buffer buffer with the request text (allocated)
+ * @return int number of requests
+ */
+static int build_requests(Source* source, const char** *request_list, char** buffer);
+
+/**
+ * @brief Send requests of one client and measure their latencies.
+ *
+ * @param argument LoadClient*
+ */
+static void* run_client(void* argument);
+
+/**
+ * @brief Compare doubles for qsort().
+ */
+static int compare_doubles(const void* a, const void* b);
+
+static const size_t MAX_NAME_LENGTH = 1024;
+static char socket_name[MAX_NAME_LENGTH] = "query.sock";
+static char text_source_name[MAX_NAME_LENGTH] = "onegin.txt";
+
+static int client_count = 4;
+static int requests_per_client = 1000;
+
+static const char** requests = NULL;
+static int request_variety = 0;
+
+static const int NUMBER_OF_TAGS = 4;
+static const struct ActionTag LINE_TAGS[NUMBER_OF_TAGS] = {
+    {
+        .name = {'S', ""},
+        .action = {
+            .parameters = (void*[]) {&socket_name},
+            .parameters_length = 1,
+            .function = edit_string,
+        },
+        .description = "sets the socket the server listens on."
+    },
+    {
+        .name = {'R', ""},
+        .action = {
+            .parameters = (void*[]) {&text_source_name},
+            .parameters_length = 1,
+            .function = edit_string,
+        },
+        .description = "sets the file query words are taken from (the one the server loaded)."
+    },
+    {
+        .name = {'C', ""},
+        .action = {
+            .parameters = (void*[]) {&client_count},
+            .parameters_length = 1,
+            .function = edit_int,
+        },
+        .description = "sets the number of concurrent clients."
+    },
+    {
+        .name = {'N', ""},
+        .action = {
+            .parameters = (void*[]) {&requests_per_client},
+            .parameters_length = 1,
+            .function = edit_int,
+        },
+        .description = "sets the number of requests every client sends."
+    },
+};
+
+int main(const int argc, const char** argv) {
+    setlocale(LC_ALL, "C.UTF-8");
+    errno = 0;
+
+    parse_args(argc, argv, NUMBER_OF_TAGS, LINE_TAGS);
+    log_init("query_load.log", ABSOLUTE_IMPORTANCE, &errno);
+
+    if (client_count < 1) client_count = 1;
+    if (requests_per_client < 1) requests_per_client = 1;
+    if (strlen(socket_name) >= sizeof(sockaddr_un::sun_path)) {
+        printf("Socket name %s is too long.\n", socket_name);
+        return EXIT_FAILURE;
+    }
+
+    Source source = {};
+    char* request_buffer = NULL;
+    if (map_file(text_source_name, &source, &errno) == READING_FAILURE) {
+        printf("Failed to read file %s.\n", text_source_name);
+        return EXIT_FAILURE;
+    }
+    request_variety = build_requests(&source, &requests, &request_buffer);
+    unmap_file(&source);
+    if (request_variety <= 0) {
+        printf("File %s has no words to query.\n", text_source_name);
+        return EXIT_FAILURE;
+    }
+
+    LoadClient* clients = (LoadClient*)calloc(client_count, sizeof(*clients));
+    pthread_t* threads = (pthread_t*)calloc(client_count, sizeof(*threads));
+    double* latencies = (double*)calloc((size_t)client_count * requests_per_client, sizeof(*latencies));
+    if (!clients || !threads || !latencies) return EXIT_FAILURE;
+
+    double start = current_time();
+    for (int client_id = 0; client_id < client_count; client_id++) {
+        clients[client_id].id = client_id;
+        clients[client_id].request_count = requests_per_client;
+        clients[client_id].latencies = latencies + (size_t)client_id * requests_per_client;
+        pthread_create(&threads[client_id], NULL, run_client, &clients[client_id]);
+    }
+
+    long matched_lines = 0, received_lines = 0;
+    int failed_count = 0;
+    for (int client_id = 0; client_id < client_count; client_id++) {
+        pthread_join(threads[client_id], NULL);
+        matched_lines += clients[client_id].matched_lines;
+        received_lines += clients[client_id].received_lines;
+        failed_count += clients[client_id].failed;
+    }
+    double elapsed = current_time() - start;
+
+    if (failed_count) {
+        printf("%d of %d clients failed to talk to the server on %s.\n", failed_count, client_count, socket_name);
+        return EXIT_FAILURE;
+    }
+
+    size_t total = (size_t)client_count * requests_per_client;
+    qsort(latencies, total, sizeof(*latencies), compare_doubles);
+
+    printf("%-24s %12d\n", "clients", client_count);
+    printf("%-24s %12zu\n", "requests", total);
+    printf("%-24s %12.3f\n", "seconds", elapsed);
+    printf("%-24s %12.1f\n", "requests per second", (double)total / elapsed);
+    printf("%-24s %12.1f\n", "lines matched per req", (double)matched_lines / (double)total);
+    printf("%-24s %12.1f\n", "lines sent per req", (double)received_lines / (double)total);
+    printf("%-24s %12.1f\n", "p50 latency, us", latencies[total / 2] * 1e6);
+    printf("%-24s %12.1f\n", "p95 latency, us", latencies[total * 95 / 100] * 1e6);
+    printf("%-24s %12.1f\n", "p99 latency, us", latencies[total * 99 / 100] * 1e6);
+    printf("%-24s %12.1f\n", "max latency, us", latencies[total - 1] * 1e6);
+
+    free(latencies);
+    free(threads);
+    free(clients);
+    free(requests);
+    free(request_buffer);
+    log_close();
+
+    return EXIT_SUCCESS;
+}
+
+static double current_time() {
+    struct timespec moment = {};
+    clock_gettime(CLOCK_MONOTONIC, &moment);
+    return (double)moment.tv_sec + (double)moment.tv_nsec * 1e-9;
+}
+
+/**
+ * @brief Check if the byte separates words.
+ */
+static inline bool is_separator(char byte) {
+    return byte == ' ' || byte == '\t' || byte == '\r' || byte == '\n';
+}
+
+static int build_requests(Source* source, const char** *request_list, char** buffer) {
+    U8line* lines = NULL;
+    int length = parse_source(source, &lines, NULL, &errno);
+    if (length == READING_FAILURE) return READING_FAILURE;
+
+    //* Every line gives at most two requests no longer than the line and their command.
+    *buffer = (char*)malloc(2 * source->size + 20 * (size_t)length + 1);
+    *request_list = (const char**)calloc(2 * (size_t)length + 1, sizeof(**request_list));
+    if (!*buffer || !*request_list) {
+        free(lines);
+        return READING_FAILURE;
+    }
+
+    char* output = *buffer;
+    int count = 0;
+    for (int line_id = 0; line_id < length; line_id++) {
+        const char* begin = lines[line_id].begin();
+        const char* end = lines[line_id].end();
+        while (begin < end && is_separator(*begin)) begin++;
+        while (end > begin && is_separator(end[-1])) end--;
+        if (begin == end) continue;
+
+        const char* first_end = begin;
+        while (first_end < end && !is_separator(*first_end)) first_end++;
+        const char* last_begin = end;
+        while (last_begin > begin && !is_separator(last_begin[-1])) last_begin--;
+
+        (*request_list)[count++] = output;
+        output += sprintf(output, "PREFIX %.*s\n", (int)(first_end - begin), begin) + 1;
+        (*request_list)[count++] = output;
+        output += sprintf(output, "SUFFIX %.*s\n", (int)(end - last_begin), last_begin) + 1;
+    }
+
+    free(lines);
+    return count;
+}
+
+/**
+ * @brief Send all bytes to the socket.
+ */
+static bool send_all(int fd, const char* data, size_t size) {
+    while (size) {
+        ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return false;
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+/**
+ * @brief Read more bytes into the reader, keeping the unread ones.
+ */
+static bool fill_reader(AnswerReader* reader) {
+    if (reader->start) {
+        memmove(reader->data, reader->data + reader->start, reader->end - reader->start);
+        reader->end -= reader->start;
+        reader->start = 0;
+    }
+    if (reader->end == sizeof(reader->data)) return false;
+
+    ssize_t received = 0;
+    do received = recv(reader->fd, reader->data + reader->end, sizeof(reader->data) - reader->end, 0);
+    while (received < 0 && errno == EINTR);
+    if (received <= 0) return false;
+
+    reader->end += received;
+    return true;
+}
+
+/**
+ * @brief Read the answer: its status line and the lines that follow it.
+ *
+ * @return bool false if the connection broke or the answer is an error
+ */
+static bool read_answer(AnswerReader* reader, int* matched, int* sent) {
+    char* newline = NULL;
+    while (!(newline = (char*)memchr(reader->data + reader->start, '\n', reader->end - reader->start))) {
+        if (!fill_reader(reader)) return false;
+    }
+    *newline = '\0';
+    bool success = sscanf(reader->data + reader->start, "OK %d %d", matched, sent) == 2;
+    reader->start = newline + 1 - reader->data;
+    if (!success) return false;
+
+    //* Lines themselves are only counted, so long ones never have to fit into the buffer.
+    for (int remaining = *sent; remaining > 0;) {
+        newline = (char*)memchr(reader->data + reader->start, '\n', reader->end - reader->start);
+        if (newline) {
+            reader->start = newline + 1 - reader->data;
+            remaining--;
+            continue;
+        }
+
+        reader->start = reader->end;
+        if (!fill_reader(reader)) return false;
+    }
+    return true;
+}
+
+static void* run_client(void* argument) {
+    LoadClient* client = (LoadClient*)argument;
+
+    AnswerReader* reader = (AnswerReader*)calloc(1, sizeof(*reader));
+    if (!reader) {
+        client->failed = true;
+        return NULL;
+    }
+
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, socket_name, strlen(socket_name) + 1);
+
+    reader->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (reader->fd == -1 || connect(reader->fd, (const sockaddr*)&address, sizeof(address)) != 0) {
+        client->failed = true;
+        if (reader->fd != -1) close(reader->fd);
+        free(reader);
+        return NULL;
+    }
+
+    //* Clients walk the requests with different strides, so they do not query the same words in lockstep.
+    unsigned position = (unsigned)client->id * 7919u;
+    unsigned stride = 2 * (unsigned)client->id + 1;
+    for (int request_id = 0; request_id < client->request_count; request_id++) {
+        const char* request = requests[(position += stride) % request_variety];
+
+        double start = current_time();
+        int matched = 0, sent = 0;
+        if (!send_all(reader->fd, request, strlen(request)) || !read_answer(reader, &matched, &sent)) {
+            client->failed = true;
+            break;
+        }
+        client->latencies[request_id] = current_time() - start;
+
+        client->matched_lines += matched;
+        client->received_lines += sent;
+    }
+
+    send_all(reader->fd, "QUIT\n", 5);
+    close(reader->fd);
+    free(reader);
+    return NULL;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double first = *(const double*)a, second = *(const double*)b;
+    return (first > second) - (first < second);
+}
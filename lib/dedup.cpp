@@ -0,0 +1,182 @@
+#include "dedup.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "util/dbg/debug.h"
+#include "sorting.h"
+
+static const int EMPTY_SLOT = -1;
+
+/**
+ * @brief Slot of the hash table.
+ *
+ * @param hash upper bits of the line hash, checked before the lines are compared
+ * @param line first line of the group (EMPTY_SLOT if the slot is free)
+ */
+struct GroupSlot {
+    uint32_t hash;
+    int line;
+};
+
+/**
+ * @brief Mix bits of the value, so every input bit affects the upper bits of the result.
+ */
+static inline uint64_t mix_hash(uint64_t value) {
+    value *= 0xBF58476D1CE4E5B9ull;
+    return value ^ (value >> 31);
+}
+
+/**
+ * @brief Hash bytes of the line eight at a time.
+ */
+static uint64_t hash_bytes(const char* data, size_t size) {
+    uint64_t hash = mix_hash(0x9E3779B97F4A7C15ull ^ size);
+    for (; size >= sizeof(uint64_t); data += sizeof(uint64_t), size -= sizeof(uint64_t)) {
+        uint64_t word = 0;
+        memcpy(&word, data, sizeof(word));
+        hash = mix_hash(hash ^ word);
+    }
+    if (size) {
+        uint64_t word = 0;
+        memcpy(&word, data, size);
+        hash = mix_hash(hash ^ word);
+    }
+    return hash;
+}
+
+/**
+ * @brief Order lines by their position in the text.
+ */
+struct CompareIndices {
+    template <typename Line>
+    int operator()(const Line& a, const Line& b) const {
+        return (a.index > b.index) - (a.index < b.index);
+    }
+};
+
+template <typename Line>
+static int _group_lines(const Line* text, int text_length, Line** uniques, LineGroups* groups, Arena* arena,
+                        int* error_code) {
+    _LOG_FAIL_CHECK_(text && uniques && groups && arena, "error", ERROR_REPORTS, return READING_FAILURE;, error_code, EFAULT);
+
+    //* Table is at most half full, so probe sequences stay short even if every line is distinct.
+    size_t capacity = 1;
+    while (capacity < 2 * (size_t)text_length) capacity <<= 1;
+
+    //* Table is only needed while the groups are counted, so it comes from the heap.
+    GroupSlot* table = (GroupSlot*)malloc(capacity * sizeof(*table));
+    int* line_groups = (int*)arena_alloc(arena, text_length * sizeof(*line_groups), error_code);
+    int* group_starts = (int*)arena_alloc(arena, (text_length + 1) * sizeof(*group_starts), error_code);
+    int* members = (int*)arena_alloc(arena, text_length * sizeof(*members), error_code);
+    _LOG_FAIL_CHECK_(table && line_groups && group_starts && members, "error", ERROR_REPORTS,
+                     free(table);return READING_FAILURE;, error_code, ENOMEM);
+
+    for (size_t slot_id = 0; slot_id < capacity; slot_id++) table[slot_id] = {0, EMPTY_SLOT};
+
+    int unique_count = 0;
+    for (int line_id = 0; line_id < text_length; line_id++) {
+        const Line* line = &text[line_id];
+        size_t size = line->length * sizeof(*line->sequence);
+        uint64_t hash = hash_bytes((const char*)line->sequence, size);
+        uint32_t short_hash = (uint32_t)(hash >> 32);
+
+        size_t slot_id = hash & (capacity - 1);
+        for (;; slot_id = (slot_id + 1) & (capacity - 1)) {
+            GroupSlot* slot = &table[slot_id];
+            if (slot->line == EMPTY_SLOT) {
+                *slot = {short_hash, line_id};
+                line_groups[line_id] = unique_count;
+                group_starts[unique_count++] = 0;
+                break;
+            }
+
+            const Line* first = &text[slot->line];
+            if (slot->hash == short_hash && first->length == line->length &&
+                memcmp(first->sequence, line->sequence, size) == 0) {
+                line_groups[line_id] = line_groups[slot->line];
+                break;
+            }
+        }
+
+        group_starts[line_groups[line_id]]++;
+    }
+
+    free(table);
+
+    Line* representatives = (Line*)arena_alloc(arena, unique_count * sizeof(*representatives), error_code);
+    _LOG_FAIL_CHECK_(representatives, "error", ERROR_REPORTS, return READING_FAILURE;, error_code, ENOMEM);
+
+    //* Sizes of the groups become their starts, members are then put in the order of the text.
+    int position = 0;
+    for (int group_id = 0; group_id < unique_count; group_id++) {
+        int size = group_starts[group_id];
+        group_starts[group_id] = position;
+        position += size;
+    }
+    group_starts[unique_count] = position;
+
+    for (int line_id = 0; line_id < text_length; line_id++) {
+        members[group_starts[line_groups[line_id]]++] = line_id;
+    }
+    for (int group_id = unique_count; group_id > 0; group_id--) group_starts[group_id] = group_starts[group_id - 1];
+    group_starts[0] = 0;
+
+    for (int group_id = 0; group_id < unique_count; group_id++) {
+        representatives[group_id] = text[members[group_starts[group_id]]];
+    }
+
+    *uniques = representatives;
+    groups->unique_count = unique_count;
+    groups->group_starts = group_starts;
+    groups->members = members;
+    groups->line_groups = line_groups;
+
+    return unique_count;
+}
+
+template <typename Line, typename Compare>
+static void _expand_groups(const Line* sorted, int unique_count, const Line* text, const LineGroups* groups,
+                           Line* output, Compare comparison, int* error_code) {
+    _LOG_FAIL_CHECK_(sorted && text && groups && output, "error", ERROR_REPORTS, return;, error_code, EFAULT);
+
+    int position = 0;
+    for (int unique_id = 0; unique_id < unique_count;) {
+        //* Distinct lines may still have equal keys (they differ in skipped characters only),
+        //* stable sort would have kept their lines in the order of the text.
+        int run_end = unique_id + 1;
+        while (run_end < unique_count && comparison(sorted[unique_id], sorted[run_end]) == 0) run_end++;
+
+        int run_start = position;
+        bool merged = run_end - unique_id > 1;
+        for (; unique_id < run_end; unique_id++) {
+            int group = groups->line_groups[sorted[unique_id].index];
+            for (int member_id = groups->group_starts[group]; member_id < groups->group_starts[group + 1]; member_id++) {
+                output[position++] = text[groups->members[member_id]];
+            }
+        }
+
+        if (merged) msort(output + run_start, position - run_start, CompareIndices(), NULL, error_code);
+    }
+}
+
+int group_lines(const Charline* text, int text_length, Charline** uniques, LineGroups* groups, Arena* arena,
+                int* error_code) {
+    return _group_lines(text, text_length, uniques, groups, arena, error_code);
+}
+
+int group_lines(const U8line* text, int text_length, U8line** uniques, LineGroups* groups, Arena* arena,
+                int* error_code) {
+    return _group_lines(text, text_length, uniques, groups, arena, error_code);
+}
+
+void expand_groups(const Charline* sorted, int unique_count, const Charline* text, const LineGroups* groups,
+                   Charline* output, int* error_code) {
+    _expand_groups(sorted, unique_count, text, groups, output, CompareKeys(), error_code);
+}
+
+void expand_groups(const U8line* sorted, int unique_count, const U8line* text, const LineGroups* groups,
+                   U8line* output, int* error_code) {
+    _expand_groups(sorted, unique_count, text, groups, output, CompareU8Keys(), error_code);
+}
@@ -0,0 +1,87 @@
+/**
+ * @file dedup.h
+ * @author Ilya Kudryashov (kudriashov.it@phystech.edu)
+ * @brief Collapsing of identical lines, so only distinct ones have to be sorted.
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include "txtproc.h"
+#include "util/arena.h"
+
+/**
+ * @brief Lines of the text grouped by their content.
+ *
+ * @param unique_count number of groups (distinct lines)
+ * @param group_starts position of the first member of every group in members, followed by the total line count
+ * @param members indices of the lines grouped together, ascending inside every group
+ * @param line_groups group of every line of the text
+ */
+struct LineGroups {
+    int unique_count = 0;
+    int* group_starts = NULL;
+    int* members = NULL;
+    int* line_groups = NULL;
+};
+
+/**
+ * @brief Get number of lines in the group of the line.
+ *
+ * @param groups groups of the text
+ * @param index index of the line in the text
+ * @return int number of copies of the line
+ */
+static inline int get_group_size(const LineGroups* groups, int index) {
+    int group = groups->line_groups[index];
+    return groups->group_starts[group + 1] - groups->group_starts[group];
+}
+
+/**
+ * @brief Group byte-identical lines of the text with an open-addressing hash table.
+ *
+ * @param[in] text lines of the text (index of every line should be its position in the text)
+ * @param[in] text_length number of lines in the text
+ * @param[out] uniques first line of every group in the order of the first occurrences
+ * @param[out] groups groups to fill
+ * @param[in] arena arena to allocate uniques and groups from
+ * @param[out] error_code where to put error codes
+ * @return int number of groups or READING_FAILURE
+ */
+int group_lines(const Charline* text, int text_length, Charline** uniques, LineGroups* groups, Arena* arena,
+                int* error_code = NULL);
+
+/**
+ * @brief group_lines() for UTF-8 lines.
+ */
+int group_lines(const U8line* text, int text_length, U8line** uniques, LineGroups* groups, Arena* arena,
+                int* error_code = NULL);
+
+/**
+ * @brief Replace every sorted distinct line with all lines of its group.
+ *
+ * Output is the one stable sort of the whole text would give: groups with equal keys
+ * have their lines merged in the order of the text.
+ *
+ * @param[in] sorted distinct lines sorted by their keys
+ * @param[in] unique_count number of distinct lines
+ * @param[in] text lines of the text
+ * @param[in] groups groups of the text
+ * @param[out] output buffer for all lines of the text
+ * @param[out] error_code where to put error codes
+ */
+void expand_groups(const Charline* sorted, int unique_count, const Charline* text, const LineGroups* groups,
+                   Charline* output, int* error_code = NULL);
+
+/**
+ * @brief expand_groups() for UTF-8 lines.
+ */
+void expand_groups(const U8line* sorted, int unique_count, const U8line* text, const LineGroups* groups,
+                   U8line* output, int* error_code = NULL);
+
+#endif
@@ -0,0 +1,552 @@
+#include "extsort.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <new>
+
+#include "util/dbg/debug.h"
+#include "txtproc.h"
+#include "sorting.h"
+#include "util/dbg/profiler.h"
+#include "util/bytescan.h"
+
+//* Every byte of the chunk is decoded into a character and gives at most one key character.
+static const size_t MEMORY_PER_CHUNK_BYTE = sizeof(char) + 2 * sizeof(wchar_t);
+static const size_t MIN_CHUNK_SIZE = 1 << 16;
+static const size_t RUN_BUFFER_SIZE = 1 << 16;
+//* Merge gives half of the budget to the readers, so every one of them keeps at least this much.
+static const size_t MIN_READER_BUFFER_SIZE = 1 << 13;
+
+/**
+ * @brief Header of the line record in a run file, followed by the key characters and the line bytes.
+ *
+ * @param index position of the line in the source file
+ * @param key_length number of characters in the key
+ * @param byte_length number of bytes in the line
+ */
+struct RunRecord {
+    uint64_t index;
+    uint32_t key_length;
+    uint32_t byte_length;
+};
+
+/**
+ * @brief Sorted runs stored one after another in a single temporary file.
+ *
+ * @param file temporary file (opened with the first run)
+ * @param bounds run_id-th run takes bytes from bounds[run_id] to bounds[run_id + 1]
+ * @param count number of finished runs
+ * @param capacity number of runs bounds have room for
+ */
+struct RunList {
+    FILE* file = NULL;
+    off_t* bounds = NULL;
+    int count = 0;
+    int capacity = 0;
+};
+
+/**
+ * @brief Current record of the run being merged.
+ *
+ * @param fd descriptor of the file with the runs
+ * @param position offset of the next byte to read into the buffer
+ * @param end offset of the end of the run
+ * @param buffer buffer of the reader
+ * @param buffer_size size of the buffer
+ * @param start first unread byte of the buffer
+ * @param filled number of bytes in the buffer
+ * @param exhausted set when all records of the run were consumed
+ * @param header header of the current record
+ * @param key key of the current record
+ * @param bytes bytes of the current line
+ */
+struct RunReader {
+    int fd = -1;
+    off_t position = 0;
+    off_t end = 0;
+    char* buffer = NULL;
+    size_t buffer_size = 0;
+    size_t start = 0;
+    size_t filled = 0;
+    bool exhausted = false;
+    RunRecord header = {};
+    wchar_t* key = NULL;
+    size_t key_capacity = 0;
+    char* bytes = NULL;
+    size_t byte_capacity = 0;
+};
+
+/**
+ * @brief Get number of bytes a chunk line costs on top of its bytes.
+ */
+static size_t memory_per_chunk_line() {
+    //* Line table of the parser (twice as large while it grows) with line offsets,
+    //* sorted view and scratch of mkqsort() for it.
+    return 2 * sizeof(Charline) + 2 * sizeof(size_t) + sizeof(Charline) + mkqsort_scratch_size(1, sizeof(Charline));
+}
+
+/**
+ * @brief Start new run at the end of the run file.
+ *
+ * @return FILE* file to write the run into or NULL on failure
+ */
+static FILE* new_run(RunList* runs) {
+    if (runs->count == runs->capacity) {
+        int new_capacity = runs->capacity ? runs->capacity * 2 : 16;
+        off_t* new_bounds = (off_t*)realloc(runs->bounds, (new_capacity + 1) * sizeof(*new_bounds));
+        if (!new_bounds) return NULL;
+        runs->bounds = new_bounds;
+        runs->capacity = new_capacity;
+    }
+
+    if (!runs->file) {
+        runs->file = tmpfile();
+        if (!runs->file) return NULL;
+        setvbuf(runs->file, NULL, _IOFBF, RUN_BUFFER_SIZE);
+        runs->bounds[0] = 0;
+    }
+    return runs->file;
+}
+
+/**
+ * @brief Finish the run started by new_run().
+ *
+ * @return bool true on success
+ */
+static bool finish_run(RunList* runs) {
+    off_t end = ftello(runs->file);
+    if (end < 0) return false;
+    runs->bounds[++runs->count] = end;
+    return true;
+}
+
+static void free_runs(RunList* runs) {
+    if (runs->file) fclose(runs->file);
+    free(runs->bounds);
+    *runs = {};
+}
+
+/**
+ * @brief Sort lines of the chunk and save them into a new run.
+ *
+ * @param runs list to add the run to
+ * @param source chunk of the input with parsed line offsets
+ * @param lines lines of the chunk
+ * @param line_count number of lines
+ * @param first_index index of the first line of the chunk in the whole file
+ * @param reverse sort lines by their endings
+ * @param arena arena of the chunk
+ * @return bool true on success
+ */
+static bool write_run(RunList* runs, const Source* source, const Charline* lines, int line_count,
+                      size_t first_index, bool reverse, Arena* arena) {
+    size_t view_size = line_count * sizeof(*lines);
+    size_t keys_size = get_keys_length(lines, line_count) * sizeof(wchar_t);
+    Charline* view = (Charline*)arena_alloc(arena, view_size);
+    wchar_t* keys = (wchar_t*)arena_alloc(arena, keys_size);
+    if (!view || !keys) return false;
+
+    memcpy(view, lines, view_size);
+    build_keys(view, line_count, reverse, keys);
+
+    int error_code = 0;
+    mkqsort(view, line_count, sizeof(*view), get_line_key, arena, &error_code);
+
+    FILE* file = error_code ? NULL : new_run(runs);
+    bool success = file != NULL;
+    for (int line_id = 0; line_id < line_count && success; line_id++) {
+        const Charline* line = &view[line_id];
+        size_t offset = source->offsets[line->index];
+        RunRecord header = {first_index + line->index, (uint32_t)line->key_length,
+                            (uint32_t)(source->offsets[line->index + 1] - offset - 1)};
+
+        success = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                  fwrite(line->key, sizeof(*line->key), header.key_length, file) == header.key_length &&
+                  fwrite(source->data + offset, 1, header.byte_length, file) == header.byte_length;
+    }
+
+    if (success) success = finish_run(runs);
+
+    //* Run of the other direction gets the same memory.
+    arena_release(arena, keys, keys_size);
+    arena_release(arena, view, view_size);
+    return success;
+}
+
+/**
+ * @brief Split chunk into lines and save its runs sorted both ways.
+ *
+ * @param forward_runs list of runs sorted by line beginnings
+ * @param reverse_runs list of runs sorted by line endings
+ * @param chunk bytes of the chunk (whole lines without the last '\n')
+ * @param size chunk size
+ * @param first_index index of the first line of the chunk in the whole file
+ * @param arena arena for the buffers of the chunk, it is reset once the runs are saved
+ * @return int number of lines in the chunk or READING_FAILURE
+ */
+static int process_chunk(RunList* forward_runs, RunList* reverse_runs, const char* chunk, size_t size,
+                         size_t first_index, Arena* arena) {
+    Source source = {};
+    source.data = chunk;
+    source.size = size;
+
+    Charline* lines = NULL;
+    wchar_t* buffer = NULL;
+    int line_count = parse_source(&source, &lines, &buffer, arena);
+    if (line_count == READING_FAILURE) return READING_FAILURE;
+
+    bool success = false;
+    {
+        _PROFILE_PHASE_("extsort_runs");
+        success = write_run(forward_runs, &source, lines, line_count, first_index, false, arena) &&
+                  write_run(reverse_runs, &source, lines, line_count, first_index, true, arena);
+    }
+
+    arena_reset(arena);
+    free(source.offsets);
+
+    return success ? line_count : READING_FAILURE;
+}
+
+/**
+ * @brief Copy next bytes of the run, refilling the buffer of the reader as needed.
+ *
+ * @return bool false on read error or if the run ends earlier
+ */
+static bool read_run(RunReader* reader, void* data, size_t size) {
+    char* output = (char*)data;
+    while (size) {
+        if (reader->start == reader->filled) {
+            size_t left = (size_t)(reader->end - reader->position);
+            if (!left) return false;
+
+            ssize_t received = pread(reader->fd, reader->buffer, left < reader->buffer_size ? left : reader->buffer_size,
+                                     reader->position);
+            if (received < 0 && errno == EINTR) continue;
+            if (received <= 0) return false;
+
+            reader->position += received;
+            reader->start = 0;
+            reader->filled = received;
+        }
+
+        size_t part = reader->filled - reader->start;
+        if (part > size) part = size;
+        memcpy(output, reader->buffer + reader->start, part);
+        reader->start += part;
+        output += part;
+        size -= part;
+    }
+    return true;
+}
+
+/**
+ * @brief Read next record of the run into the reader.
+ *
+ * @return bool false on read error
+ */
+static bool advance_reader(RunReader* reader) {
+    if (reader->start == reader->filled && reader->position == reader->end) {
+        reader->exhausted = true;
+        return true;
+    }
+    if (!read_run(reader, &reader->header, sizeof(reader->header))) return false;
+
+    if (reader->header.key_length > reader->key_capacity) {
+        wchar_t* new_key = (wchar_t*)realloc(reader->key, reader->header.key_length * sizeof(*new_key));
+        if (!new_key) return false;
+        reader->key = new_key;
+        reader->key_capacity = reader->header.key_length;
+    }
+
+    if (reader->header.byte_length > reader->byte_capacity) {
+        char* new_bytes = (char*)realloc(reader->bytes, reader->header.byte_length);
+        if (!new_bytes) return false;
+        reader->bytes = new_bytes;
+        reader->byte_capacity = reader->header.byte_length;
+    }
+
+    return read_run(reader, reader->key, reader->header.key_length * sizeof(*reader->key)) &&
+           read_run(reader, reader->bytes, reader->header.byte_length);
+}
+
+/**
+ * @brief Check if the current record of the first reader goes before the one of the second reader.
+ */
+static bool reader_less(const RunReader* reader_a, const RunReader* reader_b) {
+    if (reader_a->exhausted) return false;
+    if (reader_b->exhausted) return true;
+
+    uint32_t length_a = reader_a->header.key_length, length_b = reader_b->header.key_length;
+    int difference = wmemcmp(reader_a->key, reader_b->key, length_a < length_b ? length_a : length_b);
+    if (difference) return difference < 0;
+    if (length_a != length_b) return length_a < length_b;
+
+    return reader_a->header.index < reader_b->header.index;
+}
+
+/**
+ * @brief Fill the loser tree for the subtree of the node.
+ *
+ * @param tree internal nodes of the tree holding losers (leaves are run_count..2 * run_count - 1)
+ * @return int winner of the subtree
+ */
+static int build_loser_tree(int* tree, const RunReader* readers, int run_count, int node) {
+    if (node >= run_count) return node - run_count;
+
+    int left = build_loser_tree(tree, readers, run_count, node * 2);
+    int right = build_loser_tree(tree, readers, run_count, node * 2 + 1);
+
+    bool left_wins = !reader_less(&readers[right], &readers[left]);
+    tree[node] = left_wins ? right : left;
+    return left_wins ? left : right;
+}
+
+/**
+ * @brief Write the current record of the reader into the output.
+ *
+ * @param as_record write it as a run record instead of a line of text
+ * @return bool true on success
+ */
+static bool write_record(const RunReader* reader, FILE* output, bool as_record) {
+    if (!as_record) {
+        _PROFILE_COUNT_(BYTES_WRITTEN, reader->header.byte_length + 1);
+        return fwrite(reader->bytes, 1, reader->header.byte_length, output) == reader->header.byte_length &&
+               fputc('\n', output) != EOF;
+    }
+
+    return fwrite(&reader->header, sizeof(reader->header), 1, output) == 1 &&
+           fwrite(reader->key, sizeof(*reader->key), reader->header.key_length, output) == reader->header.key_length &&
+           fwrite(reader->bytes, 1, reader->header.byte_length, output) == reader->header.byte_length;
+}
+
+/**
+ * @brief Merge consecutive runs into the output.
+ *
+ * @param runs list of runs
+ * @param first first run to merge
+ * @param run_count number of runs to merge
+ * @param output file to write into
+ * @param as_records write run records instead of lines of text
+ * @param memory_budget approximate number of bytes the merge may use
+ * @return bool true on success
+ */
+static bool merge_runs(RunList* runs, int first, int run_count, FILE* output, bool as_records, size_t memory_budget) {
+    if (!run_count) return true;
+    if (fflush(runs->file)) return false;
+
+    //* Readers share half of the budget, the output buffer takes the other half.
+    size_t buffer_size = memory_budget / 2 / run_count;
+    if (buffer_size < MIN_READER_BUFFER_SIZE) buffer_size = MIN_READER_BUFFER_SIZE;
+
+    RunReader* readers = new (std::nothrow) RunReader[run_count];
+    int* tree = (int*)calloc(run_count + 1, sizeof(*tree));
+    char* buffers = (char*)malloc(run_count * buffer_size);
+    _PROFILE_HEAP_();
+
+    bool success = readers && tree && buffers;
+    for (int run_id = 0; run_id < run_count && success; run_id++) {
+        RunReader* reader = &readers[run_id];
+        reader->fd = fileno(runs->file);
+        reader->position = runs->bounds[first + run_id];
+        reader->end = runs->bounds[first + run_id + 1];
+        reader->buffer = buffers + run_id * buffer_size;
+        reader->buffer_size = buffer_size;
+        success = advance_reader(reader);
+    }
+
+    if (success) {
+        _PROFILE_PHASE_("extsort_merge");
+        tree[0] = build_loser_tree(tree, readers, run_count, 1);
+
+        while (success && !readers[tree[0]].exhausted) {
+            int winner = tree[0];
+            RunReader* reader = &readers[winner];
+
+            success = write_record(reader, output, as_records) && advance_reader(reader);
+
+            //* Winner replays its matches up to the root only against the losers of its path.
+            for (int node = (winner + run_count) / 2; node >= 1; node /= 2) {
+                if (reader_less(&readers[tree[node]], &readers[winner])) {
+                    int loser = winner;
+                    winner = tree[node];
+                    tree[node] = loser;
+                }
+            }
+            tree[0] = winner;
+        }
+    }
+
+    if (readers) {
+        for (int run_id = 0; run_id < run_count; run_id++) {
+            free(readers[run_id].key);
+            free(readers[run_id].bytes);
+        }
+    }
+    delete[] readers;
+    free(tree);
+    free(buffers);
+
+    return success;
+}
+
+/**
+ * @brief Merge groups of runs into longer ones until a single merge of at most fan_in runs is left.
+ *
+ * @return bool true on success
+ */
+static bool reduce_runs(RunList* runs, int fan_in, size_t memory_budget) {
+    while (runs->count > fan_in) {
+        _PROFILE_PHASE_("extsort_pass");
+
+        RunList merged = {};
+        bool success = true;
+        for (int first = 0; first < runs->count && success; first += fan_in) {
+            int run_count = runs->count - first < fan_in ? runs->count - first : fan_in;
+
+            FILE* output = new_run(&merged);
+            success = output && merge_runs(runs, first, run_count, output, true, memory_budget) && finish_run(&merged);
+        }
+
+        log_printf(STATUS_REPORTS, "status", "Merged %d runs into %d.\n", runs->count, merged.count);
+        free_runs(runs);
+        *runs = merged;
+        if (!success) return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Merge all runs into the text file.
+ *
+ * @return bool true on success
+ */
+static bool merge_into_file(RunList* runs, const char* file_name, int fan_in, size_t memory_budget) {
+    if (!reduce_runs(runs, fan_in, memory_budget)) return false;
+
+    FILE* output = fopen(file_name, "w");
+    if (!output) return false;
+    setvbuf(output, NULL, _IOFBF, memory_budget / 2 > RUN_BUFFER_SIZE ? memory_budget / 2 : RUN_BUFFER_SIZE);
+
+    bool success = merge_runs(runs, 0, runs->count, output, false, memory_budget);
+
+    if (fclose(output)) success = false;
+    return success;
+}
+
+/**
+ * @brief Find how many whole lines from the beginning of the chunk the memory budget lets sort at once.
+ *
+ * @param chunk read bytes
+ * @param filled number of read bytes
+ * @param end_of_file set if the bytes end the file (so the last line needs no '\n')
+ * @param memory_budget approximate number of bytes the sort may use
+ * @return size_t size of the lines without the '\n' after the last one or SIZE_MAX if there is no whole line
+ */
+static size_t cut_chunk(const char* chunk, size_t filled, bool end_of_file, size_t memory_budget) {
+    const char* end = chunk + filled;
+    size_t line_cost = memory_per_chunk_line();
+
+    size_t chunk_size = SIZE_MAX;
+    size_t line_count = 0;
+    for (const char* line_end = find_byte(chunk, end, '\n'); ; line_end = find_byte(line_end + 1, end, '\n')) {
+        if (line_end == end && !end_of_file) break;
+
+        //* First line is taken whatever its size is, there is no way to sort less.
+        line_count++;
+        size_t size = line_end - chunk;
+        if (chunk_size != SIZE_MAX && size * MEMORY_PER_CHUNK_BYTE + line_count * line_cost > memory_budget) break;
+        chunk_size = size;
+
+        if (line_end == end) break;
+    }
+    return chunk_size;
+}
+
+void external_sort(const char* source_name, const char* sorted_name, const char* rhymed_name,
+                   size_t memory_budget, int* error_code) {
+    _LOG_FAIL_CHECK_(source_name, "error", ERROR_REPORTS, return;, error_code, EFAULT);
+    _LOG_FAIL_CHECK_(sorted_name, "error", ERROR_REPORTS, return;, error_code, EFAULT);
+    _LOG_FAIL_CHECK_(rhymed_name, "error", ERROR_REPORTS, return;, error_code, EFAULT);
+
+    if (memory_budget < MIN_EXTERNAL_MEMORY_BUDGET) memory_budget = MIN_EXTERNAL_MEMORY_BUDGET;
+    size_t chunk_capacity = memory_budget / MEMORY_PER_CHUNK_BYTE;
+    if (chunk_capacity < MIN_CHUNK_SIZE) chunk_capacity = MIN_CHUNK_SIZE;
+
+    //* Every merged run needs a reader buffer of its own.
+    size_t max_fan_in = memory_budget / 2 / MIN_READER_BUFFER_SIZE;
+    int fan_in = max_fan_in < 2 ? 2 : max_fan_in > INT_MAX ? INT_MAX : (int)max_fan_in;
+
+    int fd = open(source_name, O_RDONLY);
+    _LOG_FAIL_CHECK_(fd != -1, "error", ERROR_REPORTS, return;, error_code, ENOENT);
+
+    char* chunk = (char*)malloc(chunk_capacity);
+    _LOG_FAIL_CHECK_(chunk, "error", ERROR_REPORTS, close(fd);return;, error_code, ENOMEM);
+
+    RunList forward_runs = {}, reverse_runs = {};
+    Arena arena = {};
+    size_t filled = 0, line_index = 0;
+    bool success = true, end_of_file = false, finished = false;
+
+    while (success && !finished) {
+        if (!end_of_file && filled < chunk_capacity) {
+            ssize_t received = read(fd, chunk + filled, chunk_capacity - filled);
+            if (received < 0) {
+                if (errno == EINTR) continue;
+                success = false;
+                break;
+            }
+            _PROFILE_COUNT_(BYTES_READ, received);
+            end_of_file = received == 0;
+            filled += received;
+            continue;
+        }
+
+        //* The last line of the file is the only one not followed by '\n'.
+        size_t chunk_size = cut_chunk(chunk, filled, end_of_file, memory_budget);
+        if (chunk_size == SIZE_MAX) {
+            //* Line longer than the whole chunk, there is no choice but to hold it in memory.
+            char* new_chunk = (char*)realloc(chunk, chunk_capacity * 2);
+            if (!new_chunk) {
+                success = false;
+                break;
+            }
+            chunk = new_chunk;
+            chunk_capacity *= 2;
+            continue;
+        }
+
+        int line_count = process_chunk(&forward_runs, &reverse_runs, chunk, chunk_size, line_index, &arena);
+        if (line_count == READING_FAILURE) {
+            success = false;
+            break;
+        }
+        line_index += line_count;
+
+        finished = chunk_size == filled;
+        if (!finished) {
+            filled -= chunk_size + 1;
+            memmove(chunk, chunk + chunk_size + 1, filled);
+        }
+
+        log_printf(STATUS_REPORTS, "status", "Saved runs of %zu lines.\n", line_index);
+    }
+
+    free(chunk);
+    arena_destroy(&arena);
+    close(fd);
+
+    if (success) success = merge_into_file(&forward_runs, sorted_name, fan_in, memory_budget);
+    if (success) success = merge_into_file(&reverse_runs, rhymed_name, fan_in, memory_budget);
+
+    free_runs(&forward_runs);
+    free_runs(&reverse_runs);
+
+    _LOG_FAIL_CHECK_(success, "error", ERROR_REPORTS, return;, error_code, EIO);
+}
@@ -0,0 +1,39 @@
+/**
+ * @file extsort.h
+ * @author Ilya Kudryashov (kudriashov.it@phystech.edu)
+ * @brief Sorting of text files that do not fit into memory.
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef EXTSORT_H
+#define EXTSORT_H
+
+#include <cstddef>
+
+/**
+ * @brief Smallest memory budget external_sort() agrees to work with.
+ */
+static const size_t MIN_EXTERNAL_MEMORY_BUDGET = 1 << 20;
+
+/**
+ * @brief Sort lines of the file by their beginnings and by their endings using bounded amount of memory.
+ *
+ * Input is read in chunks, lines of every chunk are sorted by their keys and saved as runs into a temporary
+ * file of their direction. Runs are merged with a loser tree, in several passes if there are more of them
+ * than the budget gives reader buffers for. Output is the same write_source_lines() would produce for
+ * views sorted in memory.
+ *
+ * @param source_name name of the file to sort
+ * @param sorted_name name of the file to write lines sorted by their beginnings into
+ * @param rhymed_name name of the file to write lines sorted by their endings into
+ * @param memory_budget approximate number of bytes the sort may use
+ * @param error_code where to put error codes
+ */
+void external_sort(const char* source_name, const char* sorted_name, const char* rhymed_name,
+                   size_t memory_budget, int* error_code = NULL);
+
+#endif
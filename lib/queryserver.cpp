@@ -0,0 +1,576 @@
+#include "queryserver.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <atomic>
+#include <new>
+
+#include "util/dbg/debug.h"
+
+static const size_t REQUEST_BUFFER_SIZE = 1 << 16;
+static const size_t ANSWER_BUFFER_SIZE = 1 << 16;
+//* Client with this much unsent output is not read from until it takes some of it.
+static const size_t MAX_PENDING_OUTPUT = 1 << 20;
+static const int POLL_TIMEOUT = 200;
+static const int EPOLL_BATCH_SIZE = 64;
+static const size_t MAX_STATUS_LENGTH = 64;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+/**
+ * @brief Output of the client waiting to be sent.
+ *
+ * @param data buffered bytes (allocated with the first answer)
+ * @param size number of buffered bytes
+ * @param sent number of buffered bytes already sent
+ * @param capacity size of the buffer
+ * @param failed set when the output could not be buffered or the client can no longer be written to
+ */
+struct Answer {
+    char* data = NULL;
+    size_t size = 0;
+    size_t sent = 0;
+    size_t capacity = 0;
+    bool failed = false;
+};
+
+/**
+ * @brief Connection served by one of the workers.
+ *
+ * @param fd socket of the connection (non-blocking)
+ * @param requests buffer with the unanswered part of the requests (allocated when the first request comes)
+ * @param filled number of bytes in the buffer
+ * @param request_count number of answered requests
+ * @param output answers waiting to be sent
+ * @param closing set when the client asked to close the connection (nothing is answered after that)
+ * @param peer_closed set when the client finished sending (requests it sent are still answered)
+ * @param events events epoll watches for the client
+ * @param previous previous client of the worker
+ * @param next next client of the worker
+ */
+struct QueryClient {
+    int fd = -1;
+    char* requests = NULL;
+    size_t filled = 0;
+    int request_count = 0;
+    Answer output = {};
+    bool closing = false;
+    bool peer_closed = false;
+    uint32_t events = 0;
+    QueryClient* previous = NULL;
+    QueryClient* next = NULL;
+};
+
+struct QueryServer;
+
+/**
+ * @brief Thread waiting for requests of its clients with epoll and answering them.
+ *
+ * @param server server the worker belongs to
+ * @param thread thread of the worker
+ * @param epoll_fd epoll instance watching the clients
+ * @param clients clients of the worker (the listening thread adds them, the worker removes them)
+ * @param client_count number of clients
+ * @param lock mutex guarding the list of the clients
+ */
+struct QueryWorker {
+    QueryServer* server = NULL;
+    pthread_t thread = {};
+    int epoll_fd = -1;
+    QueryClient* clients = NULL;
+    std::atomic<int> client_count = {0};
+    pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+};
+
+/**
+ * @brief Pool of workers the connections are spread over.
+ *
+ * @param views views to answer queries from
+ * @param workers workers
+ * @param worker_count number of started workers
+ * @param stopping set when the workers have to exit
+ */
+struct QueryServer {
+    const QueryViews* views = NULL;
+    QueryWorker* workers = NULL;
+    int worker_count = 0;
+    std::atomic<bool> stopping = {false};
+};
+
+/**
+ * @brief Signal handler asking the accept loop to stop.
+ */
+static void request_stop(int signal_number) {
+    (void)signal_number;
+    stop_requested = 1;
+}
+
+/**
+ * @brief Send as much of the buffered output as the socket takes without blocking.
+ */
+static void flush_answer(int fd, Answer* answer) {
+    while (!answer->failed && answer->sent < answer->size) {
+        //* Client closing the connection must not kill the whole server with SIGPIPE.
+        ssize_t sent = send(fd, answer->data + answer->sent, answer->size - answer->sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        if (sent <= 0) answer->failed = true;
+        else answer->sent += sent;
+    }
+
+    //* Drained buffer of an idle client is given back, large answers should not pin their memory.
+    answer->size = answer->sent = 0;
+    if (answer->capacity > ANSWER_BUFFER_SIZE) {
+        free(answer->data);
+        answer->data = NULL;
+        answer->capacity = 0;
+    }
+}
+
+/**
+ * @brief Get number of buffered bytes of the answer that were not sent yet.
+ */
+static inline size_t pending_output(const Answer* answer) {
+    return answer->size - answer->sent;
+}
+
+/**
+ * @brief Append bytes to the answer, growing its buffer as needed.
+ */
+static void append_answer(Answer* answer, const char* data, size_t size) {
+    if (answer->failed) return;
+
+    if (size > answer->capacity - answer->size && answer->sent) {
+        //* Sent bytes are dropped before the buffer grows.
+        memmove(answer->data, answer->data + answer->sent, answer->size - answer->sent);
+        answer->size -= answer->sent;
+        answer->sent = 0;
+    }
+
+    if (size > answer->capacity - answer->size) {
+        size_t capacity = answer->capacity ? answer->capacity : ANSWER_BUFFER_SIZE;
+        while (capacity - answer->size < size) capacity *= 2;
+
+        char* data_buffer = (char*)realloc(answer->data, capacity);
+        if (!data_buffer) {
+            log_printf(ERROR_REPORTS, "error", "Not enough memory for an answer of %zu bytes.\n", answer->size + size);
+            answer->failed = true;
+            return;
+        }
+        answer->data = data_buffer;
+        answer->capacity = capacity;
+    }
+
+    memcpy(answer->data + answer->size, data, size);
+    answer->size += size;
+}
+
+/**
+ * @brief Append the zero-terminated text to the answer.
+ */
+static inline void append_text(Answer* answer, const char* text) {
+    append_answer(answer, text, strlen(text));
+}
+
+/**
+ * @brief Check if the request starts with the command.
+ */
+static inline bool is_command(const char* request, size_t command_length, const char* command) {
+    return command_length == strlen(command) && memcmp(request, command, command_length) == 0;
+}
+
+/**
+ * @brief Append the status line and at most answer_limit of the matching lines.
+ */
+static void append_lines(Answer* answer, const QueryViews* views, const U8line* lines, int count) {
+    int sent_count = views->answer_limit > 0 && count > views->answer_limit ? views->answer_limit : count;
+
+    char status[MAX_STATUS_LENGTH] = "";
+    int status_length = snprintf(status, sizeof(status), "OK %d %d\n", count, sent_count);
+    append_answer(answer, status, status_length);
+
+    for (int line_id = 0; line_id < sent_count; line_id++) {
+        append_answer(answer, lines[line_id].sequence, lines[line_id].length);
+        append_answer(answer, "\n", 1);
+    }
+}
+
+/**
+ * @brief Answer a single request.
+ *
+ * @param views views to answer queries from
+ * @param request request without the line feed
+ * @param length number of bytes in the request
+ * @param keys buffer for keys of the request (at least length + 2 bytes)
+ * @param answer answer to append to
+ * @return bool false if the client asked to close the connection
+ */
+static bool answer_request(const QueryViews* views, const char* request, size_t length, char* keys, Answer* answer) {
+    const char* space = (const char*)memchr(request, ' ', length);
+    size_t command_length = space ? (size_t)(space - request) : length;
+    const char* argument = space ? space + 1 : request + length;
+    size_t argument_length = request + length - argument;
+
+    if (is_command(request, command_length, "PREFIX") || is_command(request, command_length, "SUFFIX")) {
+        bool reverse = is_command(request, command_length, "SUFFIX");
+        const U8line* lines = reverse ? views->rhymed : views->sorted;
+
+        size_t key_length = build_query_key(argument, argument_length, reverse, keys);
+        int first = 0;
+        int count = find_key_prefix(lines, views->length, keys, key_length, &first);
+        append_lines(answer, views, lines + first, count);
+    } else if (is_command(request, command_length, "RANGE")) {
+        const char* separator = (const char*)memchr(argument, '\t', argument_length);
+        if (!separator) {
+            append_text(answer, "ERR RANGE needs two bounds separated by a tab\n");
+            return true;
+        }
+
+        size_t from_length = build_query_key(argument, separator - argument, false, keys);
+        char* to_key = keys + from_length + 1;
+        size_t to_length = build_query_key(separator + 1, argument + argument_length - separator - 1, false, to_key);
+
+        int first = find_key_bound(views->sorted, views->length, keys, from_length);
+        int last = find_key_bound(views->sorted, views->length, to_key, to_length);
+        append_lines(answer, views, views->sorted + first, last > first ? last - first : 0);
+    } else if (is_command(request, command_length, "QUIT")) {
+        return false;
+    } else {
+        append_text(answer, "ERR unknown command\n");
+    }
+    return true;
+}
+
+/**
+ * @brief Answer complete requests of the client until its output backs up.
+ */
+static void answer_requests(QueryClient* client, const QueryViews* views, char* keys) {
+    char* start = client->requests;
+    char* end = client->requests + client->filled;
+    char* line_end = NULL;
+    while (!client->closing && !client->output.failed && pending_output(&client->output) < MAX_PENDING_OUTPUT &&
+           (line_end = (char*)memchr(start, '\n', end - start))) {
+        size_t length = line_end - start;
+        if (length && start[length - 1] == '\r') length--;
+
+        client->closing = !answer_request(views, start, length, keys, &client->output);
+        client->request_count++;
+        start = line_end + 1;
+    }
+
+    client->filled = end - start;
+    memmove(client->requests, start, client->filled);
+    if (!client->closing && client->filled == REQUEST_BUFFER_SIZE) {
+        append_text(&client->output, "ERR request is too long\n");
+        client->closing = true;
+    }
+}
+
+/**
+ * @brief Send what the client takes, read what it sent and answer it.
+ *
+ * Worker never blocks on a client: reading stops while its output is backed up,
+ * the rest of the output waits for the socket to become writable.
+ *
+ * @param client client epoll reported
+ * @param views views to answer queries from
+ * @param keys buffer of the worker for keys of the requests
+ * @return bool false if the connection has to be closed
+ */
+static bool serve_client(QueryClient* client, const QueryViews* views, char* keys) {
+    if (!client->requests) {
+        client->requests = (char*)malloc(REQUEST_BUFFER_SIZE);
+        if (!client->requests) {
+            log_printf(ERROR_REPORTS, "error", "Not enough memory to serve the client.\n");
+            return false;
+        }
+    }
+
+    flush_answer(client->fd, &client->output);
+    answer_requests(client, views, keys);
+
+    if (!client->closing && !client->peer_closed && pending_output(&client->output) < MAX_PENDING_OUTPUT) {
+        ssize_t received = recv(client->fd, client->requests + client->filled, REQUEST_BUFFER_SIZE - client->filled,
+                                MSG_DONTWAIT);
+        if (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) return false;
+        client->peer_closed = received == 0;
+
+        if (received > 0) {
+            client->filled += received;
+            answer_requests(client, views, keys);
+        }
+    }
+
+    flush_answer(client->fd, &client->output);
+    if (client->output.failed) return false;
+
+    bool finished = client->closing || (client->peer_closed && !memchr(client->requests, '\n', client->filled));
+    return !finished || pending_output(&client->output);
+}
+
+/**
+ * @brief Watch for the events the client waits for: requests while its output is not backed up,
+ *        writability while there is output left.
+ *
+ * @return bool false if epoll refused the change
+ */
+static bool watch_client(int epoll_fd, QueryClient* client) {
+    size_t pending = pending_output(&client->output);
+
+    //* End of the requests is reported as readability, hang-ups and errors are reported always.
+    uint32_t events = 0;
+    if (!client->closing && !client->peer_closed && pending < MAX_PENDING_OUTPUT) events |= EPOLLIN;
+    if (pending) events |= EPOLLOUT;
+    if (events == client->events) return true;
+
+    epoll_event event = {};
+    event.events = events;
+    event.data.ptr = client;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, client->fd, &event)) return false;
+
+    client->events = events;
+    return true;
+}
+
+/**
+ * @brief Close the connection and free the client.
+ */
+static void free_client(QueryClient* client) {
+    log_printf(STATUS_REPORTS, "status", "Client disconnected after %d requests.\n", client->request_count);
+    close(client->fd);
+    free(client->requests);
+    free(client->output.data);
+    delete client;
+}
+
+/**
+ * @brief Remove the client from the worker and free it.
+ */
+static void remove_client(QueryWorker* worker, QueryClient* client) {
+    epoll_ctl(worker->epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+
+    pthread_mutex_lock(&worker->lock);
+    if (client->previous) client->previous->next = client->next;
+    else worker->clients = client->next;
+    if (client->next) client->next->previous = client->previous;
+    worker->client_count--;
+    pthread_mutex_unlock(&worker->lock);
+
+    free_client(client);
+}
+
+/**
+ * @brief Worker thread: answers requests of its clients as they come.
+ *
+ * Requests of one client are answered in order, a client that does not read its answers
+ * only stops being read from.
+ *
+ * @param argument QueryWorker*
+ */
+static void* run_worker(void* argument) {
+    QueryWorker* worker = (QueryWorker*)argument;
+    QueryServer* server = worker->server;
+
+    char* keys = (char*)malloc(REQUEST_BUFFER_SIZE + 2);
+    if (!keys) log_printf(ERROR_REPORTS, "error", "Not enough memory for a query worker.\n");
+
+    epoll_event events[EPOLL_BATCH_SIZE];
+    while (!server->stopping) {
+        int ready = epoll_wait(worker->epoll_fd, events, EPOLL_BATCH_SIZE, POLL_TIMEOUT);
+        for (int event_id = 0; event_id < ready; event_id++) {
+            QueryClient* client = (QueryClient*)events[event_id].data.ptr;
+            if (!keys || !serve_client(client, server->views, keys) || !watch_client(worker->epoll_fd, client)) {
+                remove_client(worker, client);
+            }
+        }
+    }
+
+    free(keys);
+    return NULL;
+}
+
+/**
+ * @brief Give the accepted connection to the worker with the fewest clients.
+ *
+ * @return bool false if the connection could not be added
+ */
+static bool add_client(QueryServer* server, int fd) {
+    QueryWorker* worker = &server->workers[0];
+    for (int worker_id = 1; worker_id < server->worker_count; worker_id++) {
+        if (server->workers[worker_id].client_count < worker->client_count) worker = &server->workers[worker_id];
+    }
+
+    QueryClient* client = new (std::nothrow) QueryClient;
+    if (!client) return false;
+    client->fd = fd;
+    client->events = EPOLLIN;
+
+    pthread_mutex_lock(&worker->lock);
+    client->next = worker->clients;
+    if (worker->clients) worker->clients->previous = client;
+    worker->clients = client;
+    worker->client_count++;
+    pthread_mutex_unlock(&worker->lock);
+
+    //* Client is in the list before the worker can see it, so the worker may remove it right away.
+    epoll_event event = {};
+    event.events = client->events;
+    event.data.ptr = client;
+    if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, fd, &event) == 0) return true;
+
+    pthread_mutex_lock(&worker->lock);
+    if (client->next) client->next->previous = client->previous;
+    if (client->previous) client->previous->next = client->next;
+    else worker->clients = client->next;
+    worker->client_count--;
+    pthread_mutex_unlock(&worker->lock);
+    delete client;
+    return false;
+}
+
+/**
+ * @brief Accept all pending connections.
+ *
+ * @return int number of accepted connections
+ */
+static int accept_clients(QueryServer* server, int listener) {
+    int accepted = 0;
+    while (true) {
+        int fd = accept4(listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != ECONNABORTED) {
+                log_printf(WARNINGS, "warning", "Failed to accept a connection (errno %d).\n", errno);
+            }
+            return accepted;
+        }
+
+        if (!add_client(server, fd)) {
+            log_printf(WARNINGS, "warning", "Failed to add a new client.\n");
+            close(fd);
+            continue;
+        }
+        accepted++;
+    }
+}
+
+/**
+ * @brief Start the workers.
+ *
+ * @return int number of started workers
+ */
+static int start_workers(QueryServer* server, int worker_count) {
+    server->workers = new (std::nothrow) QueryWorker[worker_count];
+    if (!server->workers) return 0;
+
+    int started = 0;
+    for (; started < worker_count; started++) {
+        QueryWorker* worker = &server->workers[started];
+        worker->server = server;
+        worker->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (worker->epoll_fd == -1) break;
+        if (pthread_create(&worker->thread, NULL, run_worker, worker)) {
+            close(worker->epoll_fd);
+            break;
+        }
+    }
+    server->worker_count = started;
+
+    if (started < worker_count) {
+        log_printf(WARNINGS, "warning", "Started %d of %d query workers.\n", started, worker_count);
+    }
+    return started;
+}
+
+/**
+ * @brief Stop the workers and disconnect all clients.
+ */
+static void stop_workers(QueryServer* server) {
+    server->stopping = true;
+
+    //* Workers may be sending a long answer to a client that does not read it.
+    for (int worker_id = 0; worker_id < server->worker_count; worker_id++) {
+        QueryWorker* worker = &server->workers[worker_id];
+        pthread_mutex_lock(&worker->lock);
+        for (QueryClient* client = worker->clients; client; client = client->next) shutdown(client->fd, SHUT_RDWR);
+        pthread_mutex_unlock(&worker->lock);
+    }
+
+    for (int worker_id = 0; worker_id < server->worker_count; worker_id++) {
+        QueryWorker* worker = &server->workers[worker_id];
+        pthread_join(worker->thread, NULL);
+
+        while (worker->clients) {
+            QueryClient* next = worker->clients->next;
+            free_client(worker->clients);
+            worker->clients = next;
+        }
+        close(worker->epoll_fd);
+    }
+
+    delete[] server->workers;
+    server->workers = NULL;
+    server->worker_count = 0;
+}
+
+void serve_queries(const char* socket_name, const QueryViews* views, int* error_code) {
+    _LOG_FAIL_CHECK_(socket_name && views, "error", ERROR_REPORTS, return;, error_code, EFAULT);
+
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    _LOG_FAIL_CHECK_(strlen(socket_name) < sizeof(address.sun_path), "error", ERROR_REPORTS,
+                     return;, error_code, ENAMETOOLONG);
+    strcpy(address.sun_path, socket_name);
+
+    //* Socket left by a server that was killed is replaced, any other file is not.
+    struct stat socket_stat = {};
+    if (lstat(socket_name, &socket_stat) == 0 && S_ISSOCK(socket_stat.st_mode)) unlink(socket_name);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    _LOG_FAIL_CHECK_(listener != -1, "error", ERROR_REPORTS, return;, error_code, EIO);
+
+    bool listening = bind(listener, (const sockaddr*)&address, sizeof(address)) == 0 &&
+                     listen(listener, SOMAXCONN) == 0;
+    _LOG_FAIL_CHECK_(listening, "error", ERROR_REPORTS, close(listener);return;, error_code, EADDRINUSE);
+
+    QueryServer server = {};
+    server.views = views;
+    int worker_count = start_workers(&server, views->worker_count > 0 ? views->worker_count : 1);
+    _LOG_FAIL_CHECK_(worker_count, "error", ERROR_REPORTS,
+                     delete[] server.workers;close(listener);unlink(socket_name);return;, error_code, EAGAIN);
+
+    //* Signal may be delivered to any thread, so the loop polls the flag instead of relying on interrupted poll().
+    stop_requested = 0;
+    struct sigaction stop_action = {}, old_interrupt = {}, old_termination = {};
+    stop_action.sa_handler = request_stop;
+    sigemptyset(&stop_action.sa_mask);
+    sigaction(SIGINT, &stop_action, &old_interrupt);
+    sigaction(SIGTERM, &stop_action, &old_termination);
+
+    log_printf(STATUS_REPORTS, "status", "Serving %d lines on %s with %d workers.\n",
+               views->length, socket_name, worker_count);
+
+    int connection_count = 0;
+    while (!stop_requested) {
+        pollfd listener_poll = {listener, POLLIN, 0};
+        if (poll(&listener_poll, 1, POLL_TIMEOUT) > 0) connection_count += accept_clients(&server, listener);
+    }
+
+    close(listener);
+    unlink(socket_name);
+    stop_workers(&server);
+
+    sigaction(SIGINT, &old_interrupt, NULL);
+    sigaction(SIGTERM, &old_termination, NULL);
+
+    log_printf(STATUS_REPORTS, "status", "Server stopped after %d connections.\n", connection_count);
+}
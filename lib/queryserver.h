@@ -0,0 +1,59 @@
+/**
+ * @file queryserver.h
+ * @author Ilya Kudryashov (kudriashov.it@phystech.edu)
+ * @brief Local server answering prefix, suffix and range queries over sorted views of a text.
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef QUERYSERVER_H
+#define QUERYSERVER_H
+
+#include "txtproc.h"
+
+/*
+ * Protocol: every request is a single line, every answer starts with a status line.
+ *
+ *   PREFIX <text>         lines starting with the text
+ *   SUFFIX <text>         lines ending with the text
+ *   RANGE <from>\t<to>    lines ordered from the first one not before <from> up to the first one not before <to>
+ *   QUIT                  closes the connection
+ *
+ * Text is compared as the sorted outputs compare lines, so punctuation is ignored.
+ * Successful answer is "OK <matched> <sent>\n" followed by <sent> lines, failed one is "ERR <message>\n".
+ */
+
+/**
+ * @brief Sorted views queries are answered from, they are only read while the server runs.
+ *
+ * @param sorted lines sorted by their keys with the keys still built
+ * @param rhymed lines sorted by their inverted keys with the keys still built
+ * @param length number of lines in every view
+ * @param answer_limit maximum number of lines sent in one answer (0 for no limit)
+ * @param worker_count number of threads answering the queries
+ */
+struct QueryViews {
+    const U8line* sorted = NULL;
+    const U8line* rhymed = NULL;
+    int length = 0;
+    int answer_limit = 0;
+    int worker_count = 1;
+};
+
+/**
+ * @brief Listen on the Unix domain socket and answer queries until SIGINT or SIGTERM is received.
+ *
+ * Calling thread accepts connections and spreads them over a fixed pool of worker_count threads,
+ * each worker waits for requests of its clients with epoll, so idle connections cost no thread.
+ * Answers are sent without blocking, a client that does not read them is only stopped being read from.
+ *
+ * @param socket_name path of the socket (stale socket left at the path is replaced)
+ * @param views views to answer queries from
+ * @param error_code where to put error codes
+ */
+void serve_queries(const char* socket_name, const QueryViews* views, int* error_code = NULL);
+
+#endif
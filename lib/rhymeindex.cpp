@@ -0,0 +1,206 @@
+#include "rhymeindex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "util/dbg/debug.h"
+
+static const char RHYME_INDEX_MAGIC[8] = {'R', 'H', 'Y', 'M', 'E', 'I', 'D', 'X'};
+static const uint32_t RHYME_INDEX_VERSION = 1;
+static const uint32_t RHYME_INDEX_BYTE_ORDER = 0x01020304;
+
+static const int ENTRY_BATCH_SIZE = 4096;
+
+static_assert(sizeof(RhymeIndexHeader) % alignof(RhymeIndexEntry) == 0, "Entries have to stay aligned");
+
+void write_rhyme_index(const char* file_name, const Source* source, const U8line* rhymed, int length,
+                       int* error_code) {
+    _LOG_FAIL_CHECK_(file_name && source && rhymed, "error", ERROR_REPORTS, return;, error_code, EFAULT);
+
+    FILE* file = fopen(file_name, "wb");
+    _LOG_FAIL_CHECK_(file, "error", ERROR_REPORTS, return;, error_code, ENOENT);
+
+    RhymeIndexHeader header = {};
+    memcpy(header.magic, RHYME_INDEX_MAGIC, sizeof(header.magic));
+    header.version = RHYME_INDEX_VERSION;
+    header.byte_order = RHYME_INDEX_BYTE_ORDER;
+    header.line_count = length;
+    header.entries_offset = sizeof(header);
+    header.keys_offset = header.entries_offset + length * sizeof(RhymeIndexEntry);
+    for (int line_id = 0; line_id < length; line_id++) header.keys_size += rhymed[line_id].key_length;
+    header.text_offset = header.keys_offset + header.keys_size;
+    header.text_size = source->size;
+
+    bool success = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    //* Keys are written in the order of the entries, so binary search reads them almost sequentially.
+    RhymeIndexEntry batch[ENTRY_BATCH_SIZE];
+    uint64_t key_offset = 0;
+    for (int batch_start = 0; batch_start < length && success; batch_start += ENTRY_BATCH_SIZE) {
+        int batch_length = length - batch_start < ENTRY_BATCH_SIZE ? length - batch_start : ENTRY_BATCH_SIZE;
+        for (int entry_id = 0; entry_id < batch_length; entry_id++) {
+            const U8line* line = &rhymed[batch_start + entry_id];
+            batch[entry_id] = {(uint64_t)(line->sequence - source->data), key_offset,
+                               (uint32_t)line->length, (uint32_t)line->key_length};
+            key_offset += line->key_length;
+        }
+        success = fwrite(batch, sizeof(*batch), batch_length, file) == (size_t)batch_length;
+    }
+
+    for (int line_id = 0; line_id < length && success; line_id++) {
+        success = fwrite(rhymed[line_id].key, 1, rhymed[line_id].key_length, file) == (size_t)rhymed[line_id].key_length;
+    }
+
+    if (success && source->size) success = fwrite(source->data, 1, source->size, file) == source->size;
+    _PROFILE_COUNT_(BYTES_WRITTEN, header.text_offset + header.text_size);
+
+    if (fclose(file)) success = false;
+
+    _LOG_FAIL_CHECK_(success, "error", ERROR_REPORTS, return;, error_code, EIO);
+}
+
+/**
+ * @brief Check that the parts of the file follow each other and fill it exactly.
+ *
+ * Sizes are compared with what is left of the file, so corrupted offsets cannot overflow the sums.
+ */
+static bool is_valid_header(const RhymeIndexHeader* header, size_t size) {
+    if (memcmp(header->magic, RHYME_INDEX_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != RHYME_INDEX_VERSION || header->byte_order != RHYME_INDEX_BYTE_ORDER) return false;
+
+    if (header->line_count > (uint64_t)__INT_MAX__ || header->entries_offset != sizeof(*header)) return false;
+
+    //* Line count is below INT_MAX, so the size of the entries fits into 64 bits.
+    uint64_t entries_size = header->line_count * sizeof(RhymeIndexEntry);
+    if (entries_size > size - header->entries_offset) return false;
+    if (header->keys_offset != header->entries_offset + entries_size) return false;
+    if (header->keys_size > size - header->keys_offset) return false;
+    if (header->text_offset != header->keys_offset + header->keys_size) return false;
+
+    return header->text_size == size - header->text_offset;
+}
+
+/**
+ * @brief Check that the line and the key of the entry lie inside the text and the keys.
+ */
+static inline bool is_valid_entry(const RhymeIndex* index, const RhymeIndexEntry* entry) {
+    return entry->line_offset <= index->text_size && entry->line_length <= index->text_size - entry->line_offset &&
+           entry->key_offset <= index->keys_size && entry->key_length <= index->keys_size - entry->key_offset;
+}
+
+int open_rhyme_index(const char* file_name, RhymeIndex* index, int* error_code) {
+    _LOG_FAIL_CHECK_(file_name && index, "error", ERROR_REPORTS, return READING_FAILURE;, error_code, EFAULT);
+
+    int fd = open(file_name, O_RDONLY);
+    _LOG_FAIL_CHECK_(fd != -1, "error", ERROR_REPORTS, return READING_FAILURE;, error_code, ENOENT);
+
+    struct stat file_stat = {};
+    bool has_header = fstat(fd, &file_stat) == 0 && (size_t)file_stat.st_size >= sizeof(RhymeIndexHeader);
+    _LOG_FAIL_CHECK_(has_header, "error", ERROR_REPORTS, close(fd);return READING_FAILURE;, error_code, EIO);
+
+    //* Queries touch a few pages of a large file, it is neither read nor scanned in advance.
+    size_t size = file_stat.st_size;
+    const char* data = (const char*)mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    _LOG_FAIL_CHECK_(data != MAP_FAILED, "error", ERROR_REPORTS, return READING_FAILURE;, error_code, EIO);
+    madvise((void*)data, size, MADV_RANDOM);
+
+    const RhymeIndexHeader* header = (const RhymeIndexHeader*)data;
+    if (!is_valid_header(header, size)) {
+        munmap((void*)data, size);
+        log_printf(ERROR_REPORTS, "error", "File %s is not a rhyme index of this version.\n", file_name);
+        if (error_code) *error_code = EINVAL;
+        return READING_FAILURE;
+    }
+
+    index->data = data;
+    index->size = size;
+    index->line_count = (int)header->line_count;
+    index->entries = (const RhymeIndexEntry*)(data + header->entries_offset);
+    index->keys = data + header->keys_offset;
+    index->keys_size = header->keys_size;
+    index->text = data + header->text_offset;
+    index->text_size = header->text_size;
+
+    return READING_SUCCESS;
+}
+
+void close_rhyme_index(RhymeIndex* index) {
+    if (!index) return;
+
+    if (index->data) munmap((void*)index->data, index->size);
+    *index = {};
+}
+
+/**
+ * @brief Compare the beginning of the key of the entry with the inverted suffix.
+ *
+ * @param[out] corrupted set if the key of the entry lies outside of the file (0 is returned then)
+ * @return int memcmp() of the key cut to the length of the suffix with the suffix
+ */
+static int compare_key_prefix(const RhymeIndex* index, int entry_id, const char* suffix_key, size_t suffix_key_length,
+                              bool* corrupted) {
+    const RhymeIndexEntry* entry = &index->entries[entry_id];
+    if (!is_valid_entry(index, entry)) {
+        *corrupted = true;
+        return 0;
+    }
+
+    size_t common_length = entry->key_length < suffix_key_length ? entry->key_length : suffix_key_length;
+
+    int difference = memcmp(index->keys + entry->key_offset, suffix_key, common_length);
+    if (difference) return difference;
+
+    return entry->key_length < suffix_key_length ? -1 : 0;
+}
+
+int find_rhymes(const RhymeIndex* index, const char* suffix, size_t suffix_length, int* first, int* error_code) {
+    _LOG_FAIL_CHECK_(index && index->entries && suffix && first, "error", ERROR_REPORTS, return 0;, error_code, EFAULT);
+
+    //* Suffix is turned into an inverted key as the lines were, so its characters compare as theirs.
+    char* suffix_key = (char*)malloc(suffix_length + 1);
+    _LOG_FAIL_CHECK_(suffix_key, "error", ERROR_REPORTS, return 0;, error_code, ENOMEM);
+    size_t suffix_key_length = build_query_key(suffix, suffix_length, true, suffix_key);
+
+    bool corrupted = false;
+    int low = 0, high = index->line_count;
+    while (low < high && !corrupted) {
+        int middle = low + (high - low) / 2;
+        if (compare_key_prefix(index, middle, suffix_key, suffix_key_length, &corrupted) < 0) low = middle + 1;
+        else high = middle;
+    }
+    *first = low;
+
+    high = index->line_count;
+    while (low < high && !corrupted) {
+        int middle = low + (high - low) / 2;
+        if (compare_key_prefix(index, middle, suffix_key, suffix_key_length, &corrupted) <= 0) low = middle + 1;
+        else high = middle;
+    }
+
+    free(suffix_key);
+
+    if (corrupted) {
+        log_printf(ERROR_REPORTS, "error", "Rhyme index has an entry pointing outside of the file.\n");
+        if (error_code) *error_code = EINVAL;
+        *first = 0;
+        return 0;
+    }
+    return low - *first;
+}
+
+U8line get_rhyme(const RhymeIndex* index, int entry_id, int* error_code) {
+    _LOG_FAIL_CHECK_(index && index->entries && entry_id >= 0 && entry_id < index->line_count, "error", ERROR_REPORTS,
+                     return U8line{};, error_code, EFAULT);
+
+    const RhymeIndexEntry* entry = &index->entries[entry_id];
+    _LOG_FAIL_CHECK_(is_valid_entry(index, entry), "error", ERROR_REPORTS, return U8line{};, error_code, EINVAL);
+
+    return U8line{index->text + entry->line_offset, entry->line_length, entry_id};
+}
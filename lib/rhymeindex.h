@@ -0,0 +1,142 @@
+/**
+ * @file rhymeindex.h
+ * @author Ilya Kudryashov (kudriashov.it@phystech.edu)
+ * @brief Persistent index of lines sorted by their endings and lookup of lines by their ending.
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef RHYMEINDEX_H
+#define RHYMEINDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "txtproc.h"
+
+/**
+ * @brief Header at the beginning of the index file.
+ *
+ * Index file is the header followed by the entries, the keys and the text, all of them mapped as they are,
+ * so numbers are stored in the byte order of the machine that wrote the index.
+ *
+ * @param magic RHYME_INDEX_MAGIC
+ * @param version RHYME_INDEX_VERSION
+ * @param byte_order RHYME_INDEX_BYTE_ORDER as written by the machine that built the index
+ * @param line_count number of entries
+ * @param entries_offset position of the entries in the file
+ * @param keys_offset position of the keys in the file
+ * @param keys_size size of the keys in bytes
+ * @param text_offset position of the text in the file
+ * @param text_size size of the text in bytes
+ */
+struct RhymeIndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t line_count;
+    uint64_t entries_offset;
+    uint64_t keys_offset;
+    uint64_t keys_size;
+    uint64_t text_offset;
+    uint64_t text_size;
+};
+
+/**
+ * @brief Line of the index, entries are ordered as compare_reverse_lines() orders the lines.
+ *
+ * @param line_offset position of the line in the text
+ * @param key_offset position of the inverted key of the line in the keys
+ * @param line_length number of bytes in the line
+ * @param key_length number of bytes in the key
+ */
+struct RhymeIndexEntry {
+    uint64_t line_offset;
+    uint64_t key_offset;
+    uint32_t line_length;
+    uint32_t key_length;
+};
+
+/**
+ * @brief Index file mapped into memory.
+ *
+ * @param data file content
+ * @param size file size in bytes
+ * @param line_count number of lines in the index
+ * @param entries lines ordered by their endings
+ * @param keys inverted UTF-8 keys of the lines (see build_keys())
+ * @param keys_size size of the keys in bytes
+ * @param text bytes of the indexed text
+ * @param text_size size of the text in bytes
+ */
+struct RhymeIndex {
+    const char* data = NULL;
+    size_t size = 0;
+    int line_count = 0;
+    const RhymeIndexEntry* entries = NULL;
+    const char* keys = NULL;
+    size_t keys_size = 0;
+    const char* text = NULL;
+    size_t text_size = 0;
+};
+
+/**
+ * @brief Write index of the lines sorted by their endings.
+ *
+ * @param file_name name of the index file
+ * @param source mapped file the lines belong to
+ * @param rhymed lines sorted by their inverted keys with the keys still built
+ * @param length number of lines
+ * @param error_code where to put error codes
+ */
+void write_rhyme_index(const char* file_name, const Source* source, const U8line* rhymed, int length,
+                       int* error_code = NULL);
+
+/**
+ * @brief Map the index file and check its header.
+ *
+ * Entries are not read in advance, every entry is checked against the mapping when a query reaches it.
+ *
+ * @param file_name name of the index file
+ * @param index index to fill
+ * @param error_code where to put error codes
+ * @return int READING_SUCCESS or READING_FAILURE
+ */
+int open_rhyme_index(const char* file_name, RhymeIndex* index, int* error_code = NULL);
+
+/**
+ * @brief Unmap the index file.
+ *
+ * @param index index opened by open_rhyme_index()
+ */
+void close_rhyme_index(RhymeIndex* index);
+
+/**
+ * @brief Find lines ending with the suffix ignoring punctuation as compare_reverse_lines() does.
+ *
+ * Matching lines follow each other in the index, so they are found with two binary searches.
+ *
+ * @param[in] index opened index
+ * @param[in] suffix UTF-8 ending to look for
+ * @param[in] suffix_length number of bytes in the suffix
+ * @param[out] first position of the first matching entry
+ * @param[out] error_code where to put error codes
+ * @return int number of matching entries (0 if the search reached an entry pointing outside of the file)
+ */
+int find_rhymes(const RhymeIndex* index, const char* suffix, size_t suffix_length, int* first, int* error_code = NULL);
+
+/**
+ * @brief Get the line of the index entry.
+ *
+ * @param[in] index opened index
+ * @param[in] entry_id position of the entry
+ * @param[out] error_code where to put error codes
+ * @return U8line line pointing into the mapped text (index is the position of the entry),
+ * empty line if the entry points outside of the file
+ */
+U8line get_rhyme(const RhymeIndex* index, int entry_id, int* error_code = NULL);
+
+#endif
@@ -2,12 +2,15 @@
 
 #include <cstring>
 
+#include "util/dbg/profiler.h"
+
 static void _msort(void* array, int length, size_t cell_size, __compar_fn_t comparison, void* buffer) {
     if (length <= 1) return;
     bool init_buffer = false;
     if (!buffer) {
         init_buffer = true;
-        buffer = calloc(length, cell_size);
+        buffer = malloc(length * cell_size);
+        _PROFILE_HEAP_();
     }
 
     int mid = length / 2;
@@ -34,3 +37,180 @@ static void _msort(void* array, int length, size_t cell_size, __compar_fn_t comp
 void msort(void* array, int length, size_t cell_size, __compar_fn_t comparison) {
     _msort(array, length, cell_size, comparison, NULL);
 }
+
+/**
+ * @brief Key of the element being sorted by mkqsort().
+ * 
+ * @param key key characters
+ * @param length number of characters in the key
+ * @param position position of the element in the array before sorting
+ */
+template <typename Char>
+struct Keyref {
+    const Char* key;
+    int length;
+    int position;
+};
+
+static const int MKQSORT_INSERTION_THRESHOLD = 16;
+
+/**
+ * @brief Get character of the key at given depth.
+ * 
+ * @return int character (bytes are unsigned) or -1 if key is shorter than depth
+ */
+static inline int key_char(const Keyref<wchar_t>* ref, int depth) {
+    return depth < ref->length ? (int)ref->key[depth] : -1;
+}
+
+static inline int key_char(const Keyref<char>* ref, int depth) {
+    return depth < ref->length ? (int)(unsigned char)ref->key[depth] : -1;
+}
+
+static inline int compare_key_chars(const wchar_t* key_a, const wchar_t* key_b, int length) {
+    return wmemcmp(key_a, key_b, length);
+}
+
+static inline int compare_key_chars(const char* key_a, const char* key_b, int length) {
+    return memcmp(key_a, key_b, length);
+}
+
+/**
+ * @brief Compare two keys with equal first depth characters, falling back to their positions.
+ */
+template <typename Char>
+static inline int compare_keyrefs(const Keyref<Char>* ref_a, const Keyref<Char>* ref_b, int depth) {
+    _PROFILE_COUNT_(COMPARE_KEYS_CALLS, 1);
+    int common_length = (ref_a->length < ref_b->length ? ref_a->length : ref_b->length) - depth;
+    if (common_length > 0) {
+        int difference = compare_key_chars(ref_a->key + depth, ref_b->key + depth, common_length);
+        if (difference) return difference;
+    }
+    if (ref_a->length != ref_b->length) return ref_a->length < ref_b->length ? -1 : 1;
+    return ref_a->position - ref_b->position;
+}
+
+/**
+ * @brief Comparison of keys by their positions for the typed msort().
+ */
+struct ComparePositions {
+    template <typename Char>
+    int operator()(const Keyref<Char>& ref_a, const Keyref<Char>& ref_b) const {
+        return ref_a.position - ref_b.position;
+    }
+};
+
+template <typename Char>
+static inline void swap_keyrefs(Keyref<Char>* refs, int id_a, int id_b) {
+    Keyref<Char> temp = refs[id_a];
+    refs[id_a] = refs[id_b];
+    refs[id_b] = temp;
+}
+
+/**
+ * @brief Recursive part of mkqsort().
+ * 
+ * @param refs keys to sort
+ * @param length number of keys
+ * @param depth number of first characters all keys share
+ * @param scratch buffer for at least length / 2 + 1 keys used to order equal keys by their positions
+ */
+template <typename Char>
+static void _mkqsort(Keyref<Char>* refs, int length, int depth, Keyref<Char>* scratch) {
+    while (length > MKQSORT_INSERTION_THRESHOLD) {
+        int first = key_char(&refs[0], depth);
+        int middle = key_char(&refs[length / 2], depth);
+        int last = key_char(&refs[length - 1], depth);
+        int pivot = first < middle ? (middle < last ? middle : (first < last ? last : first)) 
+                                   : (first < last ? first : (middle < last ? last : middle));
+
+        _PROFILE_COUNT_(KEY_CHAR_COMPARISONS, length);
+
+        //* Dijkstra's three-way partition: [0, less) < pivot, [less, id) == pivot, (greater, length) > pivot.
+        int less = 0, id = 0, greater = length - 1;
+        while (id <= greater) {
+            int character = key_char(&refs[id], depth);
+            if      (character < pivot) swap_keyrefs(refs, less++, id++);
+            else if (character > pivot) swap_keyrefs(refs, id, greater--);
+            else id++;
+        }
+
+        _mkqsort(refs, less, depth, scratch);
+        _mkqsort(refs + greater + 1, length - greater - 1, depth, scratch);
+
+        refs += less;
+        length = greater + 1 - less;
+
+        if (pivot == -1) {
+            //* All keys have ended and are equal, only original order is left.
+            ComparePositions comparison;
+            _tmsort(refs, length, comparison, scratch);
+            return;
+        }
+
+        depth++;
+    }
+
+    for (int id = 1; id < length; id++) {
+        Keyref<Char> current = refs[id];
+        int insert_id = id;
+        for (; insert_id > 0 && compare_keyrefs(&refs[insert_id - 1], &current, depth) > 0; insert_id--) {
+            refs[insert_id] = refs[insert_id - 1];
+        }
+        refs[insert_id] = current;
+    }
+}
+
+/**
+ * @brief Get size of the buffer that serves for merging equal keys first and for permuting the elements afterwards.
+ */
+template <typename Char>
+static inline size_t mkqsort_buffer_size(int length, size_t cell_size) {
+    size_t buffer_size = length * cell_size;
+    size_t merge_size = (length / 2 + 1) * sizeof(Keyref<Char>);
+    return buffer_size < merge_size ? merge_size : buffer_size;
+}
+
+template <typename Char>
+static void _mkqsort_array(void* array, int length, size_t cell_size, 
+                           const Char* (*get_key)(const void*, int*), Arena* arena, int* error_code) {
+    if (length <= 1) return;
+
+    size_t refs_size = length * sizeof(Keyref<Char>);
+    size_t buffer_size = mkqsort_buffer_size<Char>(length, cell_size);
+
+    Keyref<Char>* refs = (Keyref<Char>*)arena_or_heap_alloc(arena, refs_size);
+    void* buffer = arena_or_heap_alloc(arena, buffer_size);
+    _LOG_FAIL_CHECK_(refs && buffer, "error", ERROR_REPORTS, 
+                     arena_or_heap_free(arena, buffer, buffer_size);arena_or_heap_free(arena, refs, refs_size);return;, 
+                     error_code, ENOMEM);
+
+    for (int id = 0; id < length; id++) {
+        refs[id].key = get_key((char*)array + id * cell_size, &refs[id].length);
+        refs[id].position = id;
+    }
+
+    _mkqsort(refs, length, 0, (Keyref<Char>*)buffer);
+
+    for (int id = 0; id < length; id++) {
+        memcpy((char*)buffer + id * cell_size, (char*)array + refs[id].position * cell_size, cell_size);
+    }
+    memcpy(array, buffer, length * cell_size);
+
+    //* Released in reverse order, so the arena gets both of them back.
+    arena_or_heap_free(arena, buffer, buffer_size);
+    arena_or_heap_free(arena, refs, refs_size);
+}
+
+size_t mkqsort_scratch_size(int length, size_t cell_size) {
+    static_assert(sizeof(Keyref<wchar_t>) == sizeof(Keyref<char>), "Both key kinds take the same scratch");
+    return length * sizeof(Keyref<wchar_t>) + mkqsort_buffer_size<wchar_t>(length, cell_size);
+}
+
+void mkqsort(void* array, int length, size_t cell_size, key_getter_t get_key, Arena* arena, int* error_code) {
+    _mkqsort_array(array, length, cell_size, get_key, arena, error_code);
+}
+
+void mkqsort(void* array, int length, size_t cell_size, byte_key_getter_t get_key, Arena* arena, int* error_code) {
+    _mkqsort_array(array, length, cell_size, get_key, arena, error_code);
+}
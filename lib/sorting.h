@@ -13,6 +13,12 @@
 #define ALGO_H
 
 #include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+#include "util/dbg/debug.h"
+#include "util/taskpool.h"
+#include "util/arena.h"
 
 /**
  * @brief Sort the array with the merge sort algorithm.
@@ -27,4 +33,357 @@ void msort(void* array, int length, size_t cell_size, __compar_fn_t comparison);
 //* does not use any recursion and generally can be replaced with simple defile.
 //* Modern compilers, though, probably automatically detect things like this one.
 
+static const int MSORT_INSERTION_THRESHOLD = 16;
+
+/**
+ * @brief Recursive part of the typed msort().
+ * 
+ * @param array pointer to the first element of the array
+ * @param length array element count
+ * @param comparison comparison functor
+ * @param buffer buffer for at least length / 2 + 1 elements
+ */
+template <typename T, typename Compare>
+void _tmsort(T* array, int length, Compare& comparison, T* buffer) {
+    if (length <= MSORT_INSERTION_THRESHOLD) {
+        for (int id = 1; id < length; id++) {
+            T current = array[id];
+            int insert_id = id;
+            for (; insert_id > 0 && comparison(array[insert_id - 1], current) > 0; insert_id--) {
+                array[insert_id] = array[insert_id - 1];
+            }
+            array[insert_id] = current;
+        }
+        return;
+    }
+
+    int mid = length / 2;
+    _tmsort(array,       mid,          comparison, buffer);
+    _tmsort(array + mid, length - mid, comparison, buffer);
+
+    //* Halves that are already in order do not need merging.
+    if (comparison(array[mid - 1], array[mid]) <= 0) return;
+
+    memcpy((void*)buffer, array, mid * sizeof(*array));
+
+    int left_id = 0, right_id = mid, id = 0;
+    while (left_id < mid && right_id < length) {
+        if (comparison(buffer[left_id], array[right_id]) > 0) {
+            array[id++] = array[right_id++];
+        } else {
+            array[id++] = buffer[left_id++];
+        }
+    }
+    while (left_id < mid) array[id++] = buffer[left_id++];
+}
+
+/**
+ * @brief Sort the array with the merge sort algorithm letting compiler inline the comparison.
+ * 
+ * Same ordering as the untyped msort() gives with the same comparison.
+ * 
+ * @tparam T trivially copyable element type
+ * @tparam Compare functor with int operator()(const T&, const T&) returning values as strcmp() does
+ * @param array pointer to the first element of the array
+ * @param length array element count
+ * @param comparison comparison functor
+ * @param arena arena to take the buffer from (heap is used if it is NULL)
+ * @param error_code where to put error codes
+ */
+template <typename T, typename Compare>
+void msort(T* array, int length, Compare comparison, Arena* arena = NULL, int* error_code = NULL) {
+    if (length <= 1) return;
+    size_t buffer_size = (length / 2 + 1) * sizeof(*array);
+    T* buffer = (T*)arena_or_heap_alloc(arena, buffer_size);
+    _LOG_FAIL_CHECK_(buffer, "error", ERROR_REPORTS, return;, error_code, ENOMEM);
+    _tmsort(array, length, comparison, buffer);
+    arena_or_heap_free(arena, buffer, buffer_size);
+}
+
+/**
+ * @brief Restore the max-heap property below the position.
+ * 
+ * @param heap heap (largest element first)
+ * @param length number of elements in the heap
+ * @param position element to move down
+ * @param comparison comparison functor
+ */
+template <typename T, typename Compare>
+void _sift_down(T* heap, int length, int position, Compare& comparison) {
+    T element = heap[position];
+    for (int child = 2 * position + 1; child < length; child = 2 * position + 1) {
+        if (child + 1 < length && comparison(heap[child + 1], heap[child]) > 0) child++;
+        if (comparison(heap[child], element) <= 0) break;
+
+        heap[position] = heap[child];
+        position = child;
+    }
+    heap[position] = element;
+}
+
+/**
+ * @brief Put count smallest elements of the array into its beginning in sorted order.
+ * 
+ * First count elements are kept as a max-heap while the rest are scanned, so it takes
+ * O(length log count) comparisons and no memory. Order of the other elements is unspecified.
+ * The sort is not stable, comparison should tell apart all elements for the result to be unique.
+ * 
+ * @param array pointer to the first element of the array
+ * @param length array element count
+ * @param count number of elements to select
+ * @param comparison comparison functor
+ */
+template <typename T, typename Compare>
+void partial_sort(T* array, int length, int count, Compare comparison) {
+    if (count > length) count = length;
+    if (count <= 0) return;
+
+    for (int position = count / 2 - 1; position >= 0; position--) _sift_down(array, count, position, comparison);
+
+    for (int id = count; id < length; id++) {
+        if (comparison(array[id], array[0]) >= 0) continue;
+
+        T element = array[id];
+        array[id] = array[0];
+        array[0] = element;
+        _sift_down(array, count, 0, comparison);
+    }
+
+    for (int end = count - 1; end > 0; end--) {
+        T largest = array[0];
+        array[0] = array[end];
+        array[end] = largest;
+        _sift_down(array, end, 0, comparison);
+    }
+}
+
+static const int PARALLEL_MSORT_GRAIN = 1 << 13;
+
+/**
+ * @brief Part of the array sorted by parallel_msort().
+ * 
+ * @param array pointer to the first element of the part
+ * @param buffer buffer of the same length as the part
+ * @param length part element count
+ * @param comparison comparison functor
+ * @param pool pool executing the tasks
+ */
+template <typename T, typename Compare>
+struct _ParallelSortJob {
+    T* array;
+    T* buffer;
+    int length;
+    Compare* comparison;
+    TaskPool* pool;
+};
+
+/**
+ * @brief Piece of the merge of two sorted halves.
+ * 
+ * @param job sort of the array being merged
+ * @param mid length of the left half
+ * @param output_begin index of the first output element of the piece
+ * @param output_end index after the last output element of the piece
+ */
+template <typename T, typename Compare>
+struct _ParallelMergeJob {
+    const _ParallelSortJob<T, Compare>* job;
+    int mid;
+    int output_begin;
+    int output_end;
+};
+
+/**
+ * @brief Find how many elements of the left sorted half go to the first output_id merged elements (co-rank).
+ * 
+ * Ties are resolved in favour of the left half, as in stable merge.
+ */
+template <typename T, typename Compare>
+int _merge_corank(const T* left, int left_length, const T* right, int right_length, int output_id, Compare& comparison) {
+    int low = output_id > right_length ? output_id - right_length : 0;
+    int high = output_id < left_length ? output_id : left_length;
+    while (low < high) {
+        int left_id = (low + high) / 2;
+        int right_id = output_id - left_id;
+        if (right_id > 0 && comparison(left[left_id], right[right_id - 1]) <= 0) {
+            low = left_id + 1;
+        } else {
+            high = left_id;
+        }
+    }
+    return low;
+}
+
+template <typename T, typename Compare>
+void _parallel_merge_task(void* argument) {
+    const _ParallelMergeJob<T, Compare>* piece = (const _ParallelMergeJob<T, Compare>*)argument;
+    const _ParallelSortJob<T, Compare>* job = piece->job;
+    Compare& comparison = *job->comparison;
+
+    const T* left = job->array;
+    const T* right = job->array + piece->mid;
+    int left_length = piece->mid, right_length = job->length - piece->mid;
+
+    int left_id = _merge_corank(left, left_length, right, right_length, piece->output_begin, comparison);
+    int right_id = piece->output_begin - left_id;
+    int left_end = _merge_corank(left, left_length, right, right_length, piece->output_end, comparison);
+    int right_end = piece->output_end - left_end;
+
+    T* output = job->buffer + piece->output_begin;
+    while (left_id < left_end && right_id < right_end) {
+        if (comparison(left[left_id], right[right_id]) > 0) *(output++) = right[right_id++];
+        else                                                *(output++) = left[left_id++];
+    }
+    while (left_id  < left_end)  *(output++) = left[left_id++];
+    while (right_id < right_end) *(output++) = right[right_id++];
+}
+
+template <typename T, typename Compare>
+void _parallel_copy_task(void* argument) {
+    const _ParallelMergeJob<T, Compare>* piece = (const _ParallelMergeJob<T, Compare>*)argument;
+    memcpy((void*)(piece->job->array + piece->output_begin), piece->job->buffer + piece->output_begin,
+           (piece->output_end - piece->output_begin) * sizeof(T));
+}
+
+template <typename T, typename Compare>
+void _parallel_msort_task(void* argument) {
+    const _ParallelSortJob<T, Compare>* job = (const _ParallelSortJob<T, Compare>*)argument;
+    if (job->length <= PARALLEL_MSORT_GRAIN) {
+        _tmsort(job->array, job->length, *job->comparison, job->buffer);
+        return;
+    }
+
+    int mid = job->length / 2;
+    _ParallelSortJob<T, Compare> left  = {job->array,       job->buffer,       mid,               job->comparison, job->pool};
+    _ParallelSortJob<T, Compare> right = {job->array + mid, job->buffer + mid, job->length - mid, job->comparison, job->pool};
+
+    TaskGroup group;
+    taskpool_spawn(job->pool, &group, _parallel_msort_task<T, Compare>, &left);
+    _parallel_msort_task<T, Compare>(&right);
+    taskpool_wait(job->pool, &group);
+
+    if ((*job->comparison)(job->array[mid - 1], job->array[mid]) <= 0) return;
+
+    //* Output is cut into equal pieces, co-rank tells where every piece starts in both halves.
+    int piece_count = (job->length + PARALLEL_MSORT_GRAIN - 1) / PARALLEL_MSORT_GRAIN;
+    if (piece_count > job->pool->thread_count * 4) piece_count = job->pool->thread_count * 4;
+
+    _ParallelMergeJob<T, Compare>* pieces = (_ParallelMergeJob<T, Compare>*)calloc(piece_count, sizeof(*pieces));
+    _ParallelMergeJob<T, Compare> whole = {job, mid, 0, job->length};
+    if (!pieces) {
+        _parallel_merge_task<T, Compare>(&whole);
+        _parallel_copy_task<T, Compare>(&whole);
+        return;
+    }
+
+    for (int piece_id = 0; piece_id < piece_count; piece_id++) {
+        pieces[piece_id] = {job, mid, (int)((long)job->length * piece_id / piece_count), 
+                                      (int)((long)job->length * (piece_id + 1) / piece_count)};
+    }
+
+    for (int piece_id = 1; piece_id < piece_count; piece_id++) {
+        taskpool_spawn(job->pool, &group, _parallel_merge_task<T, Compare>, &pieces[piece_id]);
+    }
+    _parallel_merge_task<T, Compare>(&pieces[0]);
+    taskpool_wait(job->pool, &group);
+
+    for (int piece_id = 1; piece_id < piece_count; piece_id++) {
+        taskpool_spawn(job->pool, &group, _parallel_copy_task<T, Compare>, &pieces[piece_id]);
+    }
+    _parallel_copy_task<T, Compare>(&pieces[0]);
+    taskpool_wait(job->pool, &group);
+
+    free(pieces);
+}
+
+/**
+ * @brief Sort the array with the merge sort algorithm using threads of the pool.
+ * 
+ * Halves are sorted in parallel down to PARALLEL_MSORT_GRAIN elements and merges are split
+ * into independent pieces by co-rank, result is identical to the one of the typed msort().
+ * 
+ * @tparam T trivially copyable element type
+ * @tparam Compare functor with int operator()(const T&, const T&) returning values as strcmp() does
+ * @param array pointer to the first element of the array
+ * @param length array element count
+ * @param comparison comparison functor
+ * @param pool pool to run the tasks in
+ * @param arena arena to take the buffer from (heap is used if it is NULL)
+ * @param error_code where to put error codes
+ */
+template <typename T, typename Compare>
+void parallel_msort(T* array, int length, Compare comparison, TaskPool* pool, Arena* arena = NULL,
+                    int* error_code = NULL) {
+    if (length <= 1) return;
+    if (!pool || pool->thread_count <= 1) {
+        msort(array, length, comparison, arena, error_code);
+        return;
+    }
+
+    size_t buffer_size = length * sizeof(*array);
+    T* buffer = (T*)arena_or_heap_alloc(arena, buffer_size);
+    _LOG_FAIL_CHECK_(buffer, "error", ERROR_REPORTS, return;, error_code, ENOMEM);
+
+    _ParallelSortJob<T, Compare> job = {array, buffer, length, &comparison, pool};
+    _parallel_msort_task<T, Compare>(&job);
+
+    arena_or_heap_free(arena, buffer, buffer_size);
+}
+
+/**
+ * @brief Function that gives access to the string key of an array element.
+ * 
+ * @param[in] element element of the array
+ * @param[out] key_length number of characters in the key
+ * @return const wchar_t* key characters
+ */
+typedef const wchar_t* (*key_getter_t)(const void* element, int* key_length);
+
+/**
+ * @brief Sort the array by string keys of its elements with the multikey quicksort.
+ * 
+ * Keys are compared character by character as wmemcmp() would with shorter key going first
+ * if it is the prefix of the other. Elements with equal keys keep their relative order.
+ * 
+ * @param array pointer to the first element of the array
+ * @param length array element count
+ * @param cell_size single element's size
+ * @param get_key function returning key of the element
+ * @param arena arena to take the buffers from (heap is used if it is NULL)
+ * @param error_code where to put error codes
+ */
+void mkqsort(void* array, int length, size_t cell_size, key_getter_t get_key, Arena* arena = NULL,
+             int* error_code = NULL);
+
+/**
+ * @brief Get number of bytes of scratch memory mkqsort() takes for the array.
+ * 
+ * @param length array element count
+ * @param cell_size single element's size
+ * @return size_t size of the key references and of the buffer together
+ */
+size_t mkqsort_scratch_size(int length, size_t cell_size);
+
+/**
+ * @brief Function that gives access to the byte string key of an array element.
+ * 
+ * @param[in] element element of the array
+ * @param[out] key_length number of bytes in the key
+ * @return const char* key bytes
+ */
+typedef const char* (*byte_key_getter_t)(const void* element, int* key_length);
+
+/**
+ * @brief mkqsort() for byte string keys compared as memcmp() would.
+ * 
+ * @param array pointer to the first element of the array
+ * @param length array element count
+ * @param cell_size single element's size
+ * @param get_key function returning key of the element
+ * @param arena arena to take the buffers from (heap is used if it is NULL)
+ * @param error_code where to put error codes
+ */
+void mkqsort(void* array, int length, size_t cell_size, byte_key_getter_t get_key, Arena* arena = NULL,
+             int* error_code = NULL);
+
 #endif
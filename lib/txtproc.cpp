@@ -3,11 +3,74 @@
 #include <string.h>
 #include <stdio.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <stdlib.h>
-#include <cwctype>
 #include <errno.h>
+#include <limits.h>
 
 #include "util/dbg/debug.h"
+#include "util/bytescan.h"
+#include "utf8.h"
+#include "charclass.h"
+
+static const int INITIAL_LINE_CAPACITY = 1024;
+
+static const size_t WRITE_BUFFER_SIZE = 1 << 20;
+static const int WRITEV_BATCH_SIZE = 1024;
+
+//* wlinecmp() puts the line that has skipped characters after its last sortable one
+//* right after the same line without them. Keys of such lines end with this mark,
+//* which is smaller than any sortable character.
+static const wchar_t KEY_PUNCTUATION_MARK = 1;
+//* Same mark for the skipped characters before the first sortable one in inverted keys.
+//* It is bigger than KEY_PUNCTUATION_MARK, which inverted keys use to keep direct order of the lines.
+static const wchar_t KEY_REVERSE_PUNCTUATION_MARK = 2;
+
+/**
+ * @brief Output buffer owned by a thread, released when the thread ends.
+ */
+struct WriteBuffer {
+    char* data = NULL;
+    ~WriteBuffer() { free(data); }
+};
+
+static thread_local WriteBuffer write_buffer;
+
+/**
+ * @brief Get output buffer of WRITE_BUFFER_SIZE bytes reused by all write_file() calls of the thread.
+ *
+ * @return char* buffer or NULL if it could not be allocated
+ */
+static char* get_write_buffer() {
+    if (!write_buffer.data) write_buffer.data = (char*)malloc(WRITE_BUFFER_SIZE);
+    return write_buffer.data;
+}
+
+/**
+ * @brief Write the whole buffer to the file descriptor retrying after partial writes.
+ *
+ * @param fd file descriptor
+ * @param data bytes to write
+ * @param size number of bytes to write
+ * @return bool true if all bytes were written
+ */
+static bool write_all(int fd, const char* data, size_t size) {
+    while (size) {
+        ssize_t written = write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        _PROFILE_COUNT_(BYTES_WRITTEN, written);
+        data += written;
+        size -= written;
+    }
+    return true;
+}
 
 /**
  * @brief Check if character shold not be skipped during sorting.
@@ -16,16 +79,16 @@
  * @return bool 1 if character must be sorted and 0 if it isn't
  */
 static inline int iswsortable(const wchar_t character) {
-    return iswalpha(character) || iswdigit(character);
+    return is_sortable_character(character);
 }
 
 /**
  * @brief Get the file length object.
  * 
  */
-static size_t get_file_length(FILE* file) {
+static size_t get_file_length(int fd) {
     struct stat buffer;
-    fstat(fileno(file), &buffer);
+    fstat(fd, &buffer);
     return buffer.st_size;
 }
 
@@ -53,6 +116,8 @@ int compare_line_pointers(const void* ptr_a, const void* ptr_b) {
     return 0;
 }
 
+static const ptrdiff_t VECTOR_RUN_MIN_LENGTH = 8;
+
 int wlinecmp(const wchar_t* start_a, const wchar_t* end_a, const wchar_t* start_b, const wchar_t* end_b) {
     const wchar_t *id_a = start_a, *id_b = start_b;
     int step_a = (end_a > start_a) ? 1 : -1;
@@ -68,21 +133,315 @@ int wlinecmp(const wchar_t* start_a, const wchar_t* end_a, const wchar_t* start_
         if (difference) return difference;
 
         id_a += step_a; id_b += step_b;
+
+        //* Both sides skip equal characters the same way whether they are sortable or not,
+        //* so the scalar loop is only needed from the first mismatch on. The last character of the
+        //* shorter line is left to it too, as the other line may still have characters to skip after it.
+        //* Most comparisons end at the first letter, vector blocks only pay off once the lines agree on one.
+        if (step_a == step_b) {
+            ptrdiff_t left_a = (end_a - id_a) * step_a;
+            ptrdiff_t left_b = (end_b - id_b) * step_b;
+            ptrdiff_t left = left_a < left_b ? left_a : left_b;
+            if (left >= VECTOR_RUN_MIN_LENGTH) {
+                size_t run = common_prefix_length(id_a, id_b, left, step_a < 0);
+                id_a += (ptrdiff_t)run * step_a; id_b += (ptrdiff_t)run * step_b;
+            }
+        }
     }
     
     return in_bounds(id_a, start_a, end_a) - in_bounds(id_b, start_b, end_b);
 }
 
+/**
+ * @brief Move to the next sortable character of UTF-8 sequence.
+ * 
+ * @param[in,out] position current position (start of the next character or end of the previous one if reverse is set)
+ * @param[in] begin start of the sequence
+ * @param[in] end end of the sequence
+ * @param[in] reverse move from the end to the start
+ * @param[out] character sortable character found
+ * @return bool false if there are no sortable characters left
+ */
+static inline bool next_sortable(const char** position, const char* begin, const char* end, bool reverse,
+                                 wchar_t* character) {
+    if (reverse) {
+        while (*position > begin) {
+            unsigned char byte = (unsigned char)(*position)[-1];
+            if (byte < 0x80) {
+                *character = byte;
+                (*position)--;
+                if (is_sortable_ascii(byte)) return true;
+                continue;
+            }
+            *position -= utf8_previous(begin, *position, character);
+            if (iswsortable(*character)) return true;
+        }
+    } else {
+        while (*position < end) {
+            unsigned char byte = (unsigned char)**position;
+            if (byte < 0x80) {
+                *character = byte;
+                (*position)++;
+                if (is_sortable_ascii(byte)) return true;
+                continue;
+            }
+            *position += utf8_next(*position, end, character);
+            if (iswsortable(*character)) return true;
+        }
+    }
+    return false;
+}
+
+int u8linecmp(const char* begin_a, const char* end_a, const char* begin_b, const char* end_b, bool reverse) {
+    const char* id_a = reverse ? end_a : begin_a;
+    const char* id_b = reverse ? end_b : begin_b;
+    bool matched = false;
+
+    while (true) {
+        const char* matched_a = id_a;
+        const char* matched_b = id_b;
+
+        wchar_t character_a = 0, character_b = 0;
+        bool found_a = next_sortable(&id_a, begin_a, end_a, reverse, &character_a);
+        bool found_b = next_sortable(&id_b, begin_b, end_b, reverse, &character_b);
+
+        if (found_a && found_b) {
+            int difference = character_a - character_b;
+            if (difference) return difference;
+            matched = true;
+            continue;
+        }
+
+        if (found_a != found_b || !matched) return found_a - found_b;
+
+        //* As in wlinecmp(), line that ends right after its last sortable character goes first.
+        bool tail_a = matched_a != (reverse ? begin_a : end_a);
+        bool tail_b = matched_b != (reverse ? begin_b : end_b);
+        return tail_a - tail_b;
+    }
+}
+
 int compare_lines(const void* void_a, const void* void_b) {
-    Charline* line_a = (Charline*)void_a;
-    Charline* line_b = (Charline*)void_b;
-    return wlinecmp(line_a->begin(), line_a->end() - 1, line_b->begin(), line_b->end() - 1);
+    return CompareLines()(*(const Charline*)void_a, *(const Charline*)void_b);
 }
 
 int compare_reverse_lines(const void* void_a, const void* void_b) {
-    Charline* line_a = (Charline*)void_a;
-    Charline* line_b = (Charline*)void_b;
-    return wlinecmp(line_a->end() - 1, line_a->begin(), line_b->end() - 1, line_b->begin());
+    return CompareReverseLines()(*(const Charline*)void_a, *(const Charline*)void_b);
+}
+
+int compare_keys(const void* void_a, const void* void_b) {
+    return CompareKeys()(*(const Charline*)void_a, *(const Charline*)void_b);
+}
+
+int compare_u8lines(const void* void_a, const void* void_b) {
+    return CompareU8Lines()(*(const U8line*)void_a, *(const U8line*)void_b);
+}
+
+int compare_reverse_u8lines(const void* void_a, const void* void_b) {
+    return CompareReverseU8Lines()(*(const U8line*)void_a, *(const U8line*)void_b);
+}
+
+int compare_u8keys(const void* void_a, const void* void_b) {
+    return CompareU8Keys()(*(const U8line*)void_a, *(const U8line*)void_b);
+}
+
+const char* get_u8line_key(const void* void_line, int* key_length) {
+    const U8line* line = (const U8line*)void_line;
+    *key_length = line->key_length;
+    return line->key;
+}
+
+const wchar_t* get_line_key(const void* void_line, int* key_length) {
+    const Charline* line = (const Charline*)void_line;
+    *key_length = line->key_length;
+    return line->key;
+}
+
+size_t get_keys_length(const Charline* text, int text_length) {
+    //* Key never gets longer than its line: the punctuation mark replaces at least one skipped character.
+    size_t keys_length = 1;
+    for (int line_id = 0; line_id < text_length; line_id++) {
+        keys_length += text[line_id].length;
+    }
+    return keys_length;
+}
+
+size_t get_keys_length(const U8line* text, int text_length) {
+    //* Same bound as for wide keys: marks replace at least one byte of skipped characters.
+    size_t keys_length = 1;
+    for (int line_id = 0; line_id < text_length; line_id++) {
+        keys_length += text[line_id].length;
+    }
+    return keys_length;
+}
+
+wchar_t* build_keys(Charline* text, int text_length, bool reverse, wchar_t* arena, int* error_code) {
+    _LOG_FAIL_CHECK_(text, "error", ERROR_REPORTS, return NULL;, error_code, EFAULT);
+
+    if (!arena) {
+        arena = (wchar_t*)malloc(get_keys_length(text, text_length) * sizeof(*arena));
+        _LOG_FAIL_CHECK_(arena, "error", ERROR_REPORTS, return NULL;, error_code, ENOMEM);
+    }
+
+    wchar_t* output = arena;
+    for (int line_id = 0; line_id < text_length; line_id++) {
+        Charline* line = &text[line_id];
+        wchar_t* key = output;
+
+        bool skipped_tail = false;
+        if (reverse) {
+            for (const wchar_t* id = line->end() - 1; id >= line->begin(); id--) {
+                skipped_tail = !iswsortable(*id);
+                if (!skipped_tail) *(output++) = *id;
+            }
+        } else {
+            for (const wchar_t* id = line->begin(); id < line->end(); id++) {
+                skipped_tail = !iswsortable(*id);
+                if (!skipped_tail) *(output++) = *id;
+            }
+        }
+
+        if (output != key) {
+            if (skipped_tail) *(output++) = reverse ? KEY_REVERSE_PUNCTUATION_MARK : KEY_PUNCTUATION_MARK;
+            //* Lines with equal inverted keys are ordered as their direct keys would order them.
+            if (reverse && !iswsortable(line->sequence[line->length - 1])) *(output++) = KEY_PUNCTUATION_MARK;
+        }
+
+        line->key = key;
+        line->key_length = (int)(output - key);
+    }
+
+    return arena;
+}
+
+char* build_keys(U8line* text, int text_length, bool reverse, char* arena, int* error_code) {
+    _LOG_FAIL_CHECK_(text, "error", ERROR_REPORTS, return NULL;, error_code, EFAULT);
+
+    if (!arena) {
+        arena = (char*)malloc(get_keys_length(text, text_length));
+        _LOG_FAIL_CHECK_(arena, "error", ERROR_REPORTS, return NULL;, error_code, ENOMEM);
+    }
+
+    char* output = arena;
+    for (int line_id = 0; line_id < text_length; line_id++) {
+        U8line* line = &text[line_id];
+        char* key = output;
+
+        bool skipped_tail = false;
+        const char* id = reverse ? line->end() : line->begin();
+        while (reverse ? id > line->begin() : id < line->end()) {
+            unsigned char byte = (unsigned char)(reverse ? id[-1] : *id);
+            if (byte < 0x80) {
+                //* ASCII characters need neither decoding nor the full table.
+                id += reverse ? -1 : 1;
+                skipped_tail = !is_sortable_ascii(byte);
+                if (!skipped_tail) *(output++) = (char)byte;
+                continue;
+            }
+
+            wchar_t character = 0;
+            size_t character_length = reverse ? utf8_previous(line->begin(), id, &character)
+                                               : utf8_next(id, line->end(), &character);
+            const char* start = reverse ? id - character_length : id;
+            id = reverse ? start : id + character_length;
+
+            skipped_tail = !iswsortable(character);
+            if (!skipped_tail) {
+                //* Characters keep their bytes, UTF-8 order of bytes matches the order of characters.
+                memcpy(output, start, character_length);
+                output += character_length;
+            }
+        }
+
+        if (output != key) {
+            if (skipped_tail) *(output++) = reverse ? KEY_REVERSE_PUNCTUATION_MARK : KEY_PUNCTUATION_MARK;
+            if (reverse) {
+                wchar_t last = 0;
+                utf8_previous(line->begin(), line->end(), &last);
+                if (!iswsortable(last)) *(output++) = KEY_PUNCTUATION_MARK;
+            }
+        }
+
+        line->key = key;
+        line->key_length = (int)(output - key);
+    }
+
+    return arena;
+}
+
+size_t build_query_key(const char* query, size_t query_length, bool reverse, char* key) {
+    U8line query_line = {query, query_length, 0};
+    build_keys(&query_line, 1, reverse, key);
+
+    //* Marks of skipped punctuation only tell full lines apart, keys of longer lines do not have them at this place.
+    size_t key_length = query_line.key_length;
+    while (key_length && (key[key_length - 1] == KEY_PUNCTUATION_MARK ||
+                          key[key_length - 1] == KEY_REVERSE_PUNCTUATION_MARK)) key_length--;
+    return key_length;
+}
+
+/**
+ * @brief Compare the key of the line cut to the length of the prefix with the prefix.
+ */
+static inline int compare_key_prefix(const U8line* line, const char* prefix, size_t prefix_length) {
+    size_t common_length = (size_t)line->key_length < prefix_length ? line->key_length : prefix_length;
+
+    int difference = memcmp(line->key, prefix, common_length);
+    if (difference) return difference;
+
+    return (size_t)line->key_length < prefix_length ? -1 : 0;
+}
+
+int find_key_bound(const U8line* lines, int length, const char* key, size_t key_length) {
+    int low = 0, high = length;
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        const U8line* line = &lines[middle];
+        size_t common_length = (size_t)line->key_length < key_length ? line->key_length : key_length;
+
+        int difference = memcmp(line->key, key, common_length);
+        if (difference < 0 || (!difference && (size_t)line->key_length < key_length)) low = middle + 1;
+        else high = middle;
+    }
+    return low;
+}
+
+int find_key_prefix(const U8line* lines, int length, const char* prefix, size_t prefix_length, int* first) {
+    int low = 0, high = length;
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (compare_key_prefix(&lines[middle], prefix, prefix_length) < 0) low = middle + 1;
+        else high = middle;
+    }
+    *first = low;
+
+    high = length;
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (compare_key_prefix(&lines[middle], prefix, prefix_length) <= 0) low = middle + 1;
+        else high = middle;
+    }
+    return low - *first;
+}
+
+Charline* copy_lines(const Charline* text, int text_length, int* error_code) {
+    _LOG_FAIL_CHECK_(text, "error", ERROR_REPORTS, return NULL;, error_code, EFAULT);
+
+    Charline* copy = (Charline*)malloc((text_length + 1) * sizeof(*copy));
+    _LOG_FAIL_CHECK_(copy, "error", ERROR_REPORTS, return NULL;, error_code, ENOMEM);
+
+    memcpy(copy, text, text_length * sizeof(*copy));
+    return copy;
+}
+
+U8line* copy_lines(const U8line* text, int text_length, int* error_code) {
+    _LOG_FAIL_CHECK_(text, "error", ERROR_REPORTS, return NULL;, error_code, EFAULT);
+
+    U8line* copy = (U8line*)malloc((text_length + 1) * sizeof(*copy));
+    _LOG_FAIL_CHECK_(copy, "error", ERROR_REPORTS, return NULL;, error_code, ENOMEM);
+
+    memcpy(copy, text, text_length * sizeof(*copy));
+    return copy;
 }
 
 int read_file(const char* file_name, Charline* *text, wchar_t* *buffer, int* error_code) {
@@ -90,67 +449,431 @@ int read_file(const char* file_name, Charline* *text, wchar_t* *buffer, int* err
     _LOG_FAIL_CHECK_(text,      "error", ERROR_REPORTS, return READING_FAILURE;, error_code, EFAULT);
     _LOG_FAIL_CHECK_(buffer,    "error", ERROR_REPORTS, return READING_FAILURE;, error_code, EFAULT);
 
-    FILE* file = fopen(file_name, "r");
-    _LOG_FAIL_CHECK_(file, "error", ERROR_REPORTS, return READING_FAILURE;, error_code, ENOENT);
+    Source source = {};
+    if (map_file(file_name, &source, error_code) == READING_FAILURE) return READING_FAILURE;
+
+    int line_count = parse_source(&source, text, buffer, NULL, error_code);
+
+    unmap_file(&source);
+
+    return line_count;
+}
+
+int map_file(const char* file_name, Source* source, int* error_code) {
+    _LOG_FAIL_CHECK_(file_name, "error", ERROR_REPORTS, return READING_FAILURE;, error_code, EFAULT);
+    _LOG_FAIL_CHECK_(source,    "error", ERROR_REPORTS, return READING_FAILURE;, error_code, EFAULT);
+
+    int fd = open(file_name, O_RDONLY);
+    _LOG_FAIL_CHECK_(fd != -1, "error", ERROR_REPORTS, return READING_FAILURE;, error_code, ENOENT);
+
+    size_t file_size = get_file_length(fd);
+
+    const char* content = NULL;
+    if (file_size) {
+        content = (const char*)mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        _LOG_FAIL_CHECK_(content != MAP_FAILED, "error", ERROR_REPORTS, close(fd);return READING_FAILURE;, error_code, EIO);
+        madvise((void*)content, file_size, MADV_SEQUENTIAL);
+    }
+
+    //* Mapped pages are read on the first access, every one of them is touched by the parser.
+    _PROFILE_COUNT_(BYTES_READ, file_size);
+
+    source->data = content;
+    source->size = file_size;
+    source->fd = fd;
+    source->offsets = NULL;
+    //* Pre-scan is much cheaper than decoding, ASCII files can skip decoding altogether.
+    source->ascii = is_ascii(content, content + file_size);
+
+    return READING_SUCCESS;
+}
+
+void unmap_file(Source* source) {
+    if (!source) return;
+
+    if (source->data) munmap((void*)source->data, source->size);
+    if (source->fd != -1) close(source->fd);
+    free(source->offsets);
+
+    source->data = NULL;
+    source->size = 0;
+    source->fd = -1;
+    source->offsets = NULL;
+    source->ascii = false;
+}
+
+/**
+ * @brief Double capacity of the line table and of the offsets of the lines.
+ *
+ * @param arena arena the table was allocated from (may be NULL)
+ * @param text line table
+ * @param line_size size of one line of the table
+ * @param offsets offsets of the lines (one more than the capacity)
+ * @param capacity number of lines the tables have room for
+ * @return bool false if memory could not be allocated (old tables stay valid)
+ */
+static bool grow_lines(Arena* arena, void* *text, size_t line_size, size_t* *offsets, int* capacity) {
+    if (*capacity > INT_MAX / 2) return false;
+    int new_capacity = *capacity * 2;
+
+    void* new_text = arena_or_heap_resize(arena, *text, *capacity * line_size, new_capacity * line_size);
+    if (!new_text) return false;
+    *text = new_text;
+
+    size_t* new_offsets = (size_t*)realloc(*offsets, (new_capacity + 1) * sizeof(**offsets));
+    if (!new_offsets) return false;
+    *offsets = new_offsets;
+
+    *capacity = new_capacity;
+    return true;
+}
+
+/**
+ * @brief Give unused tail of the line table back and store the offsets in the source.
+ */
+static void finish_lines(Source* source, Arena* arena, void* *text, size_t line_size, size_t* offsets,
+                         int capacity, int line_count) {
+    void* new_text = arena_or_heap_resize(arena, *text, capacity * line_size, line_count * line_size);
+    if (new_text) *text = new_text;
 
-    int file_size = get_file_length(file);
+    //* As if there was one more '\n' after the end of the file.
+    offsets[line_count] = source->size + 1;
+    size_t* new_offsets = (size_t*)realloc(offsets, (line_count + 1) * sizeof(*offsets));
 
-    int line_count = 1;
+    free(source->offsets);
+    source->offsets = new_offsets ? new_offsets : offsets;
+}
 
-    setvbuf(file, NULL, _IOFBF, file_size * sizeof(**buffer));
+int parse_source(Source* source, Charline* *text, wchar_t* *buffer, Arena* arena, int* error_code) {
+    _LOG_FAIL_CHECK_(source, "error", ERROR_REPORTS, return READING_FAILURE;, error_code, EFAULT);
+    _LOG_FAIL_CHECK_(text,   "error", ERROR_REPORTS, return READING_FAILURE;, error_code, EFAULT);
+    _LOG_FAIL_CHECK_(buffer, "error", ERROR_REPORTS, return READING_FAILURE;, error_code, EFAULT);
 
-    // TODO: Rewrite function with open(), read() and close() so it is possible to read whole file content at once.
+    const char* content = source->data;
+    size_t file_size = source->size;
 
-    *buffer = (wchar_t*)calloc(file_size, sizeof(**buffer));
-    _LOG_FAIL_CHECK_(*buffer, "error", ERROR_REPORTS, fclose(file);return READING_FAILURE;, error_code, ENOMEM);
-    for (int char_id = 0; char_id < file_size; char_id++) {
-        (*buffer)[char_id] = fgetwc(file);
-        if ((*buffer)[char_id] == (wchar_t)'\n') {
-            line_count++;
-            (*buffer)[char_id] = (wchar_t)'\0';
+    //* UTF-8 never produces more characters than there are bytes and every '\n' turns into
+    //* the terminator of its line, so +1 is only needed for the terminator of the last line.
+    *buffer = (wchar_t*)arena_or_heap_alloc(arena, (file_size + 1) * sizeof(**buffer));
+    _LOG_FAIL_CHECK_(*buffer, "error", ERROR_REPORTS, return READING_FAILURE;, error_code, ENOMEM);
+
+    //* Line table is allocated after the buffer, so in the arena it is the top allocation and grows in place.
+    int line_capacity = INITIAL_LINE_CAPACITY;
+    *text = (Charline*)arena_or_heap_alloc(arena, line_capacity * sizeof(**text));
+    size_t* offsets = (size_t*)malloc((line_capacity + 1) * sizeof(*offsets));
+    _LOG_FAIL_CHECK_(*text && offsets, "error", ERROR_REPORTS, 
+                     if (!arena) {free(*text);free(*buffer);}free(offsets);*text = NULL;*buffer = NULL;
+                     return READING_FAILURE;, error_code, ENOMEM);
+
+    int line_count = 0;
+    wchar_t* output = *buffer;
+    const char* end = content + file_size;
+    for (const char* line_start = content; ; ) {
+        const char* line_end = find_byte(line_start, end, '\n');
+
+        if (line_count == line_capacity) {
+            bool grown = grow_lines(arena, (void**)text, sizeof(**text), &offsets, &line_capacity);
+            _LOG_FAIL_CHECK_(grown, "error", ERROR_REPORTS, 
+                             if (!arena) {free(*text);free(*buffer);}free(offsets);*text = NULL;*buffer = NULL;
+                             return READING_FAILURE;, error_code, ENOMEM);
         }
+
+        size_t length = utf8_decode(line_start, line_end - line_start, output);
+        output[length] = (wchar_t)'\0';
+        offsets[line_count] = line_start - content;
+        (*text)[line_count] = Charline{output, length, line_count};
+        output += length + 1;
+        line_count++;
+
+        if (line_end == end) break;
+        line_start = line_end + 1;
     }
 
-    fclose(file);
+    finish_lines(source, arena, (void**)text, sizeof(**text), offsets, line_capacity, line_count);
 
-    *text = (Charline*)calloc(line_count, sizeof(**text));
-    _LOG_FAIL_CHECK_(*text, "error", ERROR_REPORTS, return READING_FAILURE;, error_code, ENOMEM);
-    (*text)[0] = *buffer;
-    int line_id = 0;
-    for (int char_id = 0; char_id < file_size; char_id++) {
-        if ((*buffer)[char_id] == (wchar_t)'\0') {
-            (*buffer)[char_id] = 0;
-            (*text)[++line_id] = (*buffer) + char_id + 1;
+    return line_count;
+}
+
+int parse_source(Source* source, U8line* *text, Arena* arena, int* error_code) {
+    _LOG_FAIL_CHECK_(source, "error", ERROR_REPORTS, return READING_FAILURE;, error_code, EFAULT);
+    _LOG_FAIL_CHECK_(text,   "error", ERROR_REPORTS, return READING_FAILURE;, error_code, EFAULT);
+
+    const char* content = source->data;
+    size_t file_size = source->size;
+
+    int line_capacity = INITIAL_LINE_CAPACITY;
+    *text = (U8line*)arena_or_heap_alloc(arena, line_capacity * sizeof(**text));
+    size_t* offsets = (size_t*)malloc((line_capacity + 1) * sizeof(*offsets));
+    _LOG_FAIL_CHECK_(*text && offsets, "error", ERROR_REPORTS, 
+                     if (!arena) free(*text);free(offsets);*text = NULL;return READING_FAILURE;, error_code, ENOMEM);
+
+    int line_count = 0;
+    const char* end = content + file_size;
+    for (const char* line_start = content; ; ) {
+        const char* line_end = find_byte(line_start, end, '\n');
+
+        if (line_count == line_capacity) {
+            bool grown = grow_lines(arena, (void**)text, sizeof(**text), &offsets, &line_capacity);
+            _LOG_FAIL_CHECK_(grown, "error", ERROR_REPORTS, 
+                             if (!arena) free(*text);free(offsets);*text = NULL;return READING_FAILURE;, 
+                             error_code, ENOMEM);
         }
+
+        offsets[line_count] = line_start - content;
+        (*text)[line_count] = U8line{line_start, (size_t)(line_end - line_start), line_count};
+        line_count++;
+
+        if (line_end == end) break;
+        line_start = line_end + 1;
     }
 
+    finish_lines(source, arena, (void**)text, sizeof(**text), offsets, line_capacity, line_count);
+
     return line_count;
 }
 
-void write_file(const char* file_name, const Charline* const text, int text_length, int* error_code) {
+//* Count prefix is formatted as uniq -c formats it.
+static const size_t MAX_COUNT_PREFIX_LENGTH = 16;
+
+/**
+ * @brief Write the count prefix of the line into the buffer.
+ *
+ * @return size_t number of bytes written
+ */
+static size_t print_count(char* buffer, int count) {
+    return snprintf(buffer, MAX_COUNT_PREFIX_LENGTH, "%7d ", count);
+}
+
+/**
+ * @brief Write lines to the file, each one preceded by its count if counts are given.
+ */
+static void write_lines(const char* file_name, const Charline* const text, const int* counts, int text_length,
+                        int* error_code) {
     _LOG_FAIL_CHECK_(file_name, "error", ERROR_REPORTS, return;, error_code, EFAULT);
     _LOG_FAIL_CHECK_(text, "error", ERROR_REPORTS, return;, error_code, EFAULT);
 
-    FILE* file = fopen(file_name, "w");
-    _LOG_FAIL_CHECK_(file, "error", ERROR_REPORTS, return;, error_code, ENOENT);
+    char* buffer = get_write_buffer();
+    _LOG_FAIL_CHECK_(buffer, "error", ERROR_REPORTS, return;, error_code, ENOMEM);
 
-    size_t file_length = 0;
-    for (int line_id = 0; line_id < text_length; line_id++) {
-        file_length += text[line_id].length + 1;
+    int fd = open(file_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    _LOG_FAIL_CHECK_(fd != -1, "error", ERROR_REPORTS, return;, error_code, ENOENT);
+
+    //* Largest line part that is guaranteed to fit into the empty buffer with its '\n'.
+    const size_t chunk_length = (WRITE_BUFFER_SIZE - 1) / UTF8_MAX_SEQUENCE_LENGTH;
+
+    size_t filled = 0;
+    bool success = true;
+    for (int line_id = 0; line_id < text_length && success; line_id++) {
+        const wchar_t* sequence = text[line_id].sequence;
+        size_t length = text[line_id].length;
+
+        if (counts) {
+            if (WRITE_BUFFER_SIZE - filled < MAX_COUNT_PREFIX_LENGTH) {
+                success = write_all(fd, buffer, filled);
+                filled = 0;
+            }
+            filled += print_count(buffer + filled, counts[line_id]);
+        }
+
+        while (success) {
+            size_t part = length < chunk_length ? length : chunk_length;
+            if (WRITE_BUFFER_SIZE - filled < part * UTF8_MAX_SEQUENCE_LENGTH + 1) {
+                success = write_all(fd, buffer, filled);
+                filled = 0;
+            }
+
+            filled += utf8_encode(sequence, part, buffer + filled);
+            sequence += part;
+            length -= part;
+
+            if (!length) break;
+        }
+
+        buffer[filled++] = '\n';
     }
-    
-    setvbuf(file, NULL, _IOFBF, file_length * sizeof(**text));
 
-    //TODO: Optimize IO with syscall?
+    if (success) success = write_all(fd, buffer, filled);
 
-    for (int line_id = 0; line_id < text_length; line_id++) {
-        int char_id = 0;
-        while (text[line_id][char_id] != 0) {
-            fputwc(text[line_id][char_id], file);
-            char_id++;
+    close(fd);
+
+    _LOG_FAIL_CHECK_(success, "error", ERROR_REPORTS, return;, error_code, EIO);
+}
+
+void write_file(const char* file_name, const Charline* const text, int text_length, int* error_code) {
+    write_lines(file_name, text, NULL, text_length, error_code);
+}
+
+void write_counted_file(const char* file_name, const Charline* const text, const int* counts, int text_length,
+                        int* error_code) {
+    _LOG_FAIL_CHECK_(counts, "error", ERROR_REPORTS, return;, error_code, EFAULT);
+    write_lines(file_name, text, counts, text_length, error_code);
+}
+
+/**
+ * @brief Write all buffers to the file descriptor retrying after partial writes.
+ *
+ * @param fd file descriptor
+ * @param vector buffers to write (modified on partial writes)
+ * @param count number of buffers
+ * @return bool true if all bytes were written
+ */
+static bool writev_all(int fd, struct iovec* vector, int count) {
+    while (count) {
+        ssize_t written = writev(fd, vector, count);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        _PROFILE_COUNT_(BYTES_WRITTEN, written);
+
+        while (count && (size_t)written >= vector->iov_len) {
+            written -= vector->iov_len;
+            vector++;
+            count--;
+        }
+
+        if (count) {
+            vector->iov_base = (char*)vector->iov_base + written;
+            vector->iov_len -= written;
+        }
+    }
+    return true;
+}
+
+void write_source_lines(const char* file_name, const Source* source, const Charline* const text, int text_length, 
+                        int* error_code) {
+    _LOG_FAIL_CHECK_(file_name,       "error", ERROR_REPORTS, return;, error_code, EFAULT);
+    _LOG_FAIL_CHECK_(source,          "error", ERROR_REPORTS, return;, error_code, EFAULT);
+    _LOG_FAIL_CHECK_(source->offsets, "error", ERROR_REPORTS, return;, error_code, EFAULT);
+    _LOG_FAIL_CHECK_(text,            "error", ERROR_REPORTS, return;, error_code, EFAULT);
+
+    int fd = open(file_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    _LOG_FAIL_CHECK_(fd != -1, "error", ERROR_REPORTS, return;, error_code, ENOENT);
+
+    static char newline = '\n';
+
+    struct iovec vector[WRITEV_BATCH_SIZE];
+    int count = 0;
+    bool success = true;
+
+    for (int line_id = 0; line_id < text_length && success; line_id++) {
+        int index = text[line_id].index;
+        const char* start = source->data + source->offsets[index];
+        //* Every line but the last one is followed by its own '\n' in the source.
+        size_t length = source->offsets[index + 1] - source->offsets[index];
+        bool has_newline = source->offsets[index + 1] <= source->size;
+        if (!has_newline) length--;
+
+        if (count && vector[count - 1].iov_base != &newline && 
+                (char*)vector[count - 1].iov_base + vector[count - 1].iov_len == start) {
+            //* Lines that follow each other in the source are written as one block.
+            vector[count - 1].iov_len += length;
+        } else {
+            if (count == WRITEV_BATCH_SIZE) {
+                success = writev_all(fd, vector, count);
+                count = 0;
+            }
+            vector[count++] = {(void*)start, length};
+        }
+
+        if (!has_newline) {
+            if (count == WRITEV_BATCH_SIZE) {
+                success = success && writev_all(fd, vector, count);
+                count = 0;
+            }
+            vector[count++] = {&newline, 1};
         }
-        fputwc('\n', file);
     }
 
-    fclose(file);
+    if (success) success = writev_all(fd, vector, count);
+
+    close(fd);
+
+    _LOG_FAIL_CHECK_(success, "error", ERROR_REPORTS, return;, error_code, EIO);
+}
+
+/**
+ * @brief write_lines() for UTF-8 lines.
+ */
+static void write_lines(const char* file_name, const U8line* const text, const int* counts, int text_length,
+                        int* error_code) {
+    _LOG_FAIL_CHECK_(file_name, "error", ERROR_REPORTS, return;, error_code, EFAULT);
+    _LOG_FAIL_CHECK_(text,      "error", ERROR_REPORTS, return;, error_code, EFAULT);
+
+    char* buffer = get_write_buffer();
+    _LOG_FAIL_CHECK_(buffer, "error", ERROR_REPORTS, return;, error_code, ENOMEM);
+
+    int fd = open(file_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    _LOG_FAIL_CHECK_(fd != -1, "error", ERROR_REPORTS, return;, error_code, ENOENT);
+
+    //* Sorted lines are scattered over the source, copying them is cheaper than a writev() entry per line.
+    size_t filled = 0;
+    bool success = true;
+    for (int line_id = 0; line_id < text_length && success; line_id++) {
+        const U8line* line = &text[line_id];
+
+        if (WRITE_BUFFER_SIZE - filled < line->length + 1 + (counts ? MAX_COUNT_PREFIX_LENGTH : 0)) {
+            success = write_all(fd, buffer, filled);
+            filled = 0;
+        }
+
+        if (counts) filled += print_count(buffer + filled, counts[line_id]);
+
+        if (line->length + 1 > WRITE_BUFFER_SIZE - filled) {
+            //* Count prefix may still be in the buffer, it goes first.
+            success = success && write_all(fd, buffer, filled) &&
+                      write_all(fd, line->sequence, line->length) && write_all(fd, "\n", 1);
+            filled = 0;
+            continue;
+        }
+
+        memcpy(buffer + filled, line->sequence, line->length);
+        filled += line->length;
+        buffer[filled++] = '\n';
+    }
+
+    if (success) success = write_all(fd, buffer, filled);
+
+    close(fd);
+
+    _LOG_FAIL_CHECK_(success, "error", ERROR_REPORTS, return;, error_code, EIO);
+}
+
+void write_file(const char* file_name, const U8line* const text, int text_length, int* error_code) {
+    write_lines(file_name, text, NULL, text_length, error_code);
+}
+
+void write_counted_file(const char* file_name, const U8line* const text, const int* counts, int text_length,
+                        int* error_code) {
+    _LOG_FAIL_CHECK_(counts, "error", ERROR_REPORTS, return;, error_code, EFAULT);
+    write_lines(file_name, text, counts, text_length, error_code);
+}
+
+void copy_source(const char* file_name, const Source* source, int* error_code) {
+    _LOG_FAIL_CHECK_(file_name, "error", ERROR_REPORTS, return;, error_code, EFAULT);
+    _LOG_FAIL_CHECK_(source,    "error", ERROR_REPORTS, return;, error_code, EFAULT);
+
+    int fd = open(file_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    _LOG_FAIL_CHECK_(fd != -1, "error", ERROR_REPORTS, return;, error_code, ENOENT);
+
+    loff_t offset = 0;
+    while (offset < (loff_t)source->size) {
+        ssize_t copied = copy_file_range(source->fd, &offset, fd, NULL, source->size - offset, 0);
+        if (copied <= 0) break;
+        _PROFILE_COUNT_(BYTES_WRITTEN, copied);
+    }
+
+    //* Some file systems can not copy ranges, let sendfile() do the rest.
+    while (offset < (loff_t)source->size) {
+        ssize_t copied = sendfile(fd, source->fd, &offset, source->size - offset);
+        if (copied <= 0) break;
+        _PROFILE_COUNT_(BYTES_WRITTEN, copied);
+    }
+
+    bool success = offset == (loff_t)source->size;
+    if (success) success = write_all(fd, "\n", 1);
+
+    close(fd);
+
+    _LOG_FAIL_CHECK_(success, "error", ERROR_REPORTS, return;, error_code, EIO);
 }
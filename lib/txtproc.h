@@ -14,22 +14,76 @@
 
 #include <cstddef>
 #include <wchar.h>
+#include <string.h>
 
+#include "util/dbg/profiler.h"
+#include "util/arena.h"
+
+/**
+ * @brief Line of text.
+ *
+ * @param sequence characters of the line terminated with '\0'
+ * @param length number of characters in the line
+ * @param index position of the line in the source file
+ * @param key_length number of characters in the key
+ * @param key normalized sorting key built by build_keys() (NULL if it was not built)
+ */
 struct Charline {
     const wchar_t* sequence;
     size_t length = 0;
+    int index = 0;
+    int key_length = 0;
+    const wchar_t* key = NULL;
 
     Charline operator=(const wchar_t * const new_string) { sequence = new_string; length = wcslen(sequence); return *this; }
 
     wchar_t  operator[](int index) const { return sequence[index];                            }
-    Charline operator+ (int delta) const { return Charline{sequence + delta, length - delta}; }
-    Charline operator- (int delta) const { return Charline{sequence - delta, length + delta}; }
+    Charline operator+ (int delta) const { return Charline{sequence + delta, length - delta, index}; }
+    Charline operator- (int delta) const { return Charline{sequence - delta, length + delta, index}; }
     wchar_t  operator* ()          const { return *sequence;                                  }
 
     const wchar_t* begin() const { return sequence; }
     const wchar_t* end() const { return sequence + length; }
 };
 
+/**
+ * @brief Line of text kept as UTF-8 bytes (usually right inside the mapped source file).
+ *
+ * @param sequence bytes of the line (not terminated)
+ * @param length number of bytes in the line
+ * @param index position of the line in the source file
+ * @param key_length number of bytes in the key
+ * @param key sorting key built by build_keys() as UTF-8 bytes (NULL if it was not built)
+ */
+struct U8line {
+    const char* sequence = NULL;
+    size_t length = 0;
+    int index = 0;
+    int key_length = 0;
+    const char* key = NULL;
+
+    const char* begin() const { return sequence; }
+    const char* end() const { return sequence + length; }
+};
+
+/**
+ * @brief Text file mapped into memory.
+ *
+ * @param data file content
+ * @param size file size in bytes
+ * @param fd descriptor of the opened file
+ * @param offsets byte offsets of line starts filled by parse_source(),
+ *     one more than there are lines with the last one pointing past the end of the file
+ * @param ascii set by map_file() if all bytes of the file are ASCII
+ */
+struct Source {
+    const char* data = NULL;
+    size_t size = 0;
+    int fd = -1;
+    size_t* offsets = NULL;
+    bool ascii = false;
+};
+
 enum READING_STATUSES {
     READING_SUCCESS = 0,
     READING_FAILURE = -1,
@@ -73,6 +127,253 @@ int compare_lines(const void* a, const void* b);
  */
 int compare_reverse_lines(const void* a, const void* b);
 
+/**
+ * @brief Compare keys of two lines built by build_keys() as wmemcmp() would.
+ * 
+ * @param a first line (as void*)
+ * @param b second line (as void*)
+ * @return int same sign as the comparison function the keys were built for
+ */
+int compare_keys(const void* a, const void* b);
+
+/**
+ * @brief Compare two UTF-8 byte sequences character by character ignoring punctuation, as wlinecmp() would
+ * compare their decoded characters.
+ * 
+ * @param begin_a start of the first sequence
+ * @param end_a end of the first sequence
+ * @param begin_b start of the second sequence
+ * @param end_b end of the second sequence
+ * @param reverse iterate from the ends of the sequences to their starts
+ * @return int as if decoded sequences were pushed into wlinecmp()
+ */
+int u8linecmp(const char* begin_a, const char* end_a, const char* begin_b, const char* end_b, bool reverse = false);
+
+/**
+ * @brief compare_lines() for UTF-8 lines.
+ * 
+ * @param a first line (as void*)
+ * @param b second line (as void*)
+ * @return int same sign as compare_lines() gives for decoded lines
+ */
+int compare_u8lines(const void* a, const void* b);
+
+/**
+ * @brief compare_reverse_lines() for UTF-8 lines.
+ * 
+ * @param a first line (as void*)
+ * @param b second line (as void*)
+ * @return int same sign as compare_reverse_lines() gives for decoded lines
+ */
+int compare_reverse_u8lines(const void* a, const void* b);
+
+/**
+ * @brief compare_keys() for UTF-8 lines, UTF-8 keys are ordered by memcmp() as their characters by wmemcmp().
+ * 
+ * @param a first line (as void*)
+ * @param b second line (as void*)
+ * @return int same sign as compare_keys() gives for keys of decoded lines
+ */
+int compare_u8keys(const void* a, const void* b);
+
+/**
+ * @brief compare_lines() as a functor for the typed msort().
+ */
+struct CompareLines {
+    int operator()(const Charline& a, const Charline& b) const {
+        return wlinecmp(a.begin(), a.end() - 1, b.begin(), b.end() - 1);
+    }
+};
+
+/**
+ * @brief compare_reverse_lines() as a functor for the typed msort().
+ */
+struct CompareReverseLines {
+    int operator()(const Charline& a, const Charline& b) const {
+        return wlinecmp(a.end() - 1, a.begin(), b.end() - 1, b.begin());
+    }
+};
+
+/**
+ * @brief compare_keys() as a functor for the typed msort().
+ */
+struct CompareKeys {
+    int operator()(const Charline& a, const Charline& b) const {
+        _PROFILE_COUNT_(COMPARE_KEYS_CALLS, 1);
+        int common_length = a.key_length < b.key_length ? a.key_length : b.key_length;
+        int difference = wmemcmp(a.key, b.key, common_length);
+        if (difference) return difference;
+
+        return (a.key_length > b.key_length) - (a.key_length < b.key_length);
+    }
+};
+
+/**
+ * @brief compare_u8lines() as a functor for the typed msort().
+ */
+struct CompareU8Lines {
+    int operator()(const U8line& a, const U8line& b) const {
+        return u8linecmp(a.begin(), a.end(), b.begin(), b.end(), false);
+    }
+};
+
+/**
+ * @brief compare_reverse_u8lines() as a functor for the typed msort().
+ */
+struct CompareReverseU8Lines {
+    int operator()(const U8line& a, const U8line& b) const {
+        return u8linecmp(a.begin(), a.end(), b.begin(), b.end(), true);
+    }
+};
+
+/**
+ * @brief compare_u8keys() as a functor for the typed msort().
+ */
+struct CompareU8Keys {
+    int operator()(const U8line& a, const U8line& b) const {
+        _PROFILE_COUNT_(COMPARE_KEYS_CALLS, 1);
+        int common_length = a.key_length < b.key_length ? a.key_length : b.key_length;
+        int difference = memcmp(a.key, b.key, common_length);
+        if (difference) return difference;
+
+        return (a.key_length > b.key_length) - (a.key_length < b.key_length);
+    }
+};
+
+/**
+ * @brief Order of the lines stable sort by Compare gives: ties are ordered by positions of the lines in the text.
+ */
+template <typename Compare>
+struct CompareStable {
+    template <typename Line>
+    int operator()(const Line& a, const Line& b) const {
+        int difference = Compare()(a, b);
+        if (difference) return difference;
+
+        return (a.index > b.index) - (a.index < b.index);
+    }
+};
+
+/**
+ * @brief Get the key of the line built by build_keys() (see key_getter_t in sorting.h).
+ * 
+ * @param[in] line line (as void*)
+ * @param[out] key_length number of characters in the key
+ * @return const wchar_t* key characters
+ */
+const wchar_t* get_line_key(const void* line, int* key_length);
+
+/**
+ * @brief Build sorting keys of the lines, so compare_keys() orders them exactly as 
+ * compare_lines() (or compare_reverse_lines() if reverse is set) does.
+ * 
+ * Lines equal under compare_reverse_lines() get inverted keys ordered as compare_lines() would order them,
+ * so stable sort by inverted keys gives the same result as stable sort by compare_lines() followed by
+ * stable sort by compare_reverse_lines().
+ * 
+ * @param[in,out] text lines to build keys for
+ * @param[in] text_length number of lines in the text
+ * @param[in] reverse build keys of inverted lines
+ * @param[in] arena (optional) buffer returned by previous build_keys() call for the same lines to reuse
+ * @param[out] error_code where to put error codes
+ * @return wchar_t* buffer holding all keys (should be freed after the keys are no longer needed)
+ */
+wchar_t* build_keys(Charline* text, int text_length, bool reverse = false, wchar_t* arena = NULL, int* error_code = NULL);
+
+/**
+ * @brief Get the number of characters build_keys() may write for the lines (size of the buffer it needs).
+ * 
+ * @param text lines keys will be built for
+ * @param text_length number of lines in the text
+ * @return size_t number of characters
+ */
+size_t get_keys_length(const Charline* text, int text_length);
+
+/**
+ * @brief Get the key of the UTF-8 line built by build_keys() (see byte_key_getter_t in sorting.h).
+ * 
+ * @param[in] line line (as void*)
+ * @param[out] key_length number of bytes in the key
+ * @return const char* key bytes
+ */
+const char* get_u8line_key(const void* line, int* key_length);
+
+/**
+ * @brief Build UTF-8 sorting keys of the lines, so compare_u8keys() and mkqsort() order them exactly as
+ * keys of the decoded lines would be ordered (see build_keys() for Charline).
+ * 
+ * @param[in,out] text lines to build keys for
+ * @param[in] text_length number of lines in the text
+ * @param[in] reverse build keys of inverted lines
+ * @param[in] arena (optional) buffer returned by previous build_keys() call for the same lines to reuse
+ * @param[out] error_code where to put error codes
+ * @return char* buffer holding all keys (should be freed after the keys are no longer needed)
+ */
+char* build_keys(U8line* text, int text_length, bool reverse = false, char* arena = NULL, int* error_code = NULL);
+
+/**
+ * @brief Get the number of bytes build_keys() may write for the UTF-8 lines (size of the buffer it needs).
+ * 
+ * @param text lines keys will be built for
+ * @param text_length number of lines in the text
+ * @return size_t number of bytes
+ */
+size_t get_keys_length(const U8line* text, int text_length);
+
+/**
+ * @brief Build the key the keys of lines starting with the query start with (ending with it if reverse is set).
+ * 
+ * @param[in] query UTF-8 text
+ * @param[in] query_length number of bytes in the query
+ * @param[in] reverse build the inverted key
+ * @param[out] key buffer for at least query_length + 1 bytes
+ * @return size_t number of bytes in the key
+ */
+size_t build_query_key(const char* query, size_t query_length, bool reverse, char* key);
+
+/**
+ * @brief Find the first line with the key not less than the specified one.
+ * 
+ * @param lines lines sorted by their keys
+ * @param length number of lines
+ * @param key key to look for
+ * @param key_length number of bytes in the key
+ * @return int position of the line (length if there is none)
+ */
+int find_key_bound(const U8line* lines, int length, const char* key, size_t key_length);
+
+/**
+ * @brief Find lines with keys starting with the prefix, they follow each other in the sorted lines.
+ * 
+ * @param[in] lines lines sorted by their keys
+ * @param[in] length number of lines
+ * @param[in] prefix beginning of the keys (built by build_query_key())
+ * @param[in] prefix_length number of bytes in the prefix
+ * @param[out] first position of the first matching line
+ * @return int number of matching lines
+ */
+int find_key_prefix(const U8line* lines, int length, const char* prefix, size_t prefix_length, int* first);
+
+/**
+ * @brief Copy the lines into a new array that can be reordered without touching the original one.
+ * 
+ * @param[in] text lines to copy
+ * @param[in] text_length number of lines in the text
+ * @param[out] error_code where to put error codes
+ * @return Charline* copy of the lines (should be freed)
+ */
+Charline* copy_lines(const Charline* text, int text_length, int* error_code = NULL);
+
+/**
+ * @brief Copy the UTF-8 lines into a new array that can be reordered without touching the original one.
+ * 
+ * @param[in] text lines to copy
+ * @param[in] text_length number of lines in the text
+ * @param[out] error_code where to put error codes
+ * @return U8line* copy of the lines (should be freed)
+ */
+U8line* copy_lines(const U8line* text, int text_length, int* error_code = NULL);
+
 /**
  * @brief Read text file and save its content.
  * 
@@ -84,6 +385,46 @@ int compare_reverse_lines(const void* a, const void* b);
  */
 int read_file(const char* file_name, Charline* *text, wchar_t* *buffer, int* error_code = NULL);
 
+/**
+ * @brief Open text file and map its content into memory.
+ * 
+ * @param[in] file_name name of the file to open
+ * @param[out] source mapped file
+ * @param[out] error_code where to put error codes
+ * @return READING_SUCCESS or READING_FAILURE
+ */
+int map_file(const char* file_name, Source* source, int* error_code = NULL);
+
+/**
+ * @brief Unmap the file and free its line offsets.
+ * 
+ * @param source file mapped by map_file()
+ */
+void unmap_file(Source* source);
+
+/**
+ * @brief Split mapped file into lines and decode them.
+ * 
+ * @param[in,out] source mapped file, line offsets will be saved into it
+ * @param[out] text array of links to lines that will be filled
+ * @param[out] buffer the string whole file will be written to
+ * @param[in] arena (optional) arena to allocate text and buffer from, they should be freed otherwise
+ * @param[out] error_code where to put error codes
+ * @returns text length if parsing was successful and READING_FAILURE otherwise
+ */
+int parse_source(Source* source, Charline* *text, wchar_t* *buffer, Arena* arena = NULL, int* error_code = NULL);
+
+/**
+ * @brief Split mapped file into lines pointing right into it without decoding them.
+ * 
+ * @param[in,out] source mapped file, line offsets will be saved into it
+ * @param[out] text array of lines that will be filled
+ * @param[in] arena (optional) arena to allocate text from, it should be freed otherwise
+ * @param[out] error_code where to put error codes
+ * @returns text length if parsing was successful and READING_FAILURE otherwise
+ */
+int parse_source(Source* source, U8line* *text, Arena* arena = NULL, int* error_code = NULL);
+
 /**
  * @brief Write text to file.
  * 
@@ -94,4 +435,54 @@ int read_file(const char* file_name, Charline* *text, wchar_t* *buffer, int* err
  */
 void write_file(const char* file_name, const Charline* const text, int text_length, int* error_code = NULL);
 
+/**
+ * @brief Write UTF-8 lines to file, each one followed by '\n'.
+ * 
+ * @param file_name name of the file to write text into
+ * @param text text to write
+ * @param text_length number of lines in the text
+ * @param error_code where to put error codes
+ */
+void write_file(const char* file_name, const U8line* const text, int text_length, int* error_code = NULL);
+
+/**
+ * @brief Write text to file, every line preceded by its count as uniq -c prints it.
+ * 
+ * @param file_name name of the file to write text into
+ * @param text text to write
+ * @param counts count of every line
+ * @param text_length number of lines in the text
+ * @param error_code where to put error codes
+ */
+void write_counted_file(const char* file_name, const Charline* const text, const int* counts, int text_length,
+                        int* error_code = NULL);
+
+/**
+ * @brief write_counted_file() for UTF-8 lines.
+ */
+void write_counted_file(const char* file_name, const U8line* const text, const int* counts, int text_length,
+                        int* error_code = NULL);
+
+/**
+ * @brief Write lines to file copying their original bytes from the mapped source with writev().
+ * 
+ * @param file_name name of the file to write text into
+ * @param source file the lines were parsed from
+ * @param text lines to write
+ * @param text_length number of lines in the text
+ * @param error_code where to put error codes
+ */
+void write_source_lines(const char* file_name, const Source* source, const Charline* const text, int text_length, 
+                        int* error_code = NULL);
+
+/**
+ * @brief Write the source file followed by '\n' (as write_file() would write its lines in original order)
+ * letting the kernel copy the data.
+ * 
+ * @param file_name name of the file to write text into
+ * @param source file to copy
+ * @param error_code where to put error codes
+ */
+void copy_source(const char* file_name, const Source* source, int* error_code = NULL);
+
 #endif
@@ -0,0 +1,151 @@
+#include "utf8.h"
+
+#include <stdint.h>
+#include <string.h>
+
+static const uint64_t ASCII_WORD_MASK = 0x8080808080808080ull;
+
+/**
+ * @brief Check if byte is a UTF-8 continuation byte (10xxxxxx).
+ *
+ * @param byte byte to check
+ * @return bool
+ */
+static inline bool is_continuation(const unsigned char byte) {
+    return (byte & 0xC0) == 0x80;
+}
+
+/**
+ * @brief Decode single multibyte sequence.
+ *
+ * @param[in] source start of the sequence
+ * @param[in] end end of the input
+ * @param[out] character decoded character
+ * @return size_t number of bytes consumed
+ */
+static inline size_t decode_sequence(const unsigned char* source, const unsigned char* end, wchar_t* character) {
+    const unsigned char lead = *source;
+    size_t length = 0;
+    wchar_t minimum = 0;
+    wchar_t value = 0;
+
+    if      ((lead & 0xE0) == 0xC0) { length = 2; minimum = 0x80;    value = lead & 0x1F; }
+    else if ((lead & 0xF0) == 0xE0) { length = 3; minimum = 0x800;   value = lead & 0x0F; }
+    else if ((lead & 0xF8) == 0xF0) { length = 4; minimum = 0x10000; value = lead & 0x07; }
+    else {
+        *character = lead < 0x80 ? lead : UTF8_REPLACEMENT_CHARACTER;
+        return 1;
+    }
+
+    if ((size_t)(end - source) < length) {
+        *character = UTF8_REPLACEMENT_CHARACTER;
+        return 1;
+    }
+
+    for (size_t byte_id = 1; byte_id < length; byte_id++) {
+        if (!is_continuation(source[byte_id])) {
+            *character = UTF8_REPLACEMENT_CHARACTER;
+            return 1;
+        }
+        value = (value << 6) | (source[byte_id] & 0x3F);
+    }
+
+    //* Overlong forms, surrogates and values above Unicode range are not valid UTF-8.
+    if (value < minimum || value > 0x10FFFF || (0xD800 <= value && value <= 0xDFFF)) {
+        *character = UTF8_REPLACEMENT_CHARACTER;
+        return 1;
+    }
+
+    *character = value;
+    return length;
+}
+
+size_t utf8_decode(const char* source, size_t length, wchar_t* destination) {
+    const unsigned char* id = (const unsigned char*)source;
+    const unsigned char* end = id + length;
+    wchar_t* output = destination;
+
+    while (id < end) {
+        while (end - id >= (ptrdiff_t)sizeof(uint64_t)) {
+            uint64_t word = 0;
+            memcpy(&word, id, sizeof(word));
+            if (word & ASCII_WORD_MASK) break;
+
+            for (size_t byte_id = 0; byte_id < sizeof(word); byte_id++) {
+                output[byte_id] = id[byte_id];
+            }
+            output += sizeof(word);
+            id += sizeof(word);
+        }
+
+        if (id >= end) break;
+
+        if (*id < 0x80) {
+            *(output++) = *(id++);
+            continue;
+        }
+
+        id += decode_sequence(id, end, output++);
+    }
+
+    return output - destination;
+}
+
+size_t utf8_next(const char* source, const char* end, wchar_t* character) {
+    const unsigned char* id = (const unsigned char*)source;
+    if (*id < 0x80) {
+        *character = *id;
+        return 1;
+    }
+    return decode_sequence(id, (const unsigned char*)end, character);
+}
+
+size_t utf8_previous(const char* begin, const char* end, wchar_t* character) {
+    const unsigned char* last = (const unsigned char*)end - 1;
+    if (*last < 0x80) {
+        *character = *last;
+        return 1;
+    }
+
+    const unsigned char* lead = last;
+    while (lead > (const unsigned char*)begin && is_continuation(*lead) && last - lead < (ptrdiff_t)UTF8_MAX_SEQUENCE_LENGTH - 1) {
+        lead--;
+    }
+
+    //* Valid sequence always starts with non-continuation byte, so it is decoded the same way in both directions.
+    if (!is_continuation(*lead) && decode_sequence(lead, (const unsigned char*)end, character) == (size_t)(end - (const char*)lead)) {
+        return end - (const char*)lead;
+    }
+
+    *character = UTF8_REPLACEMENT_CHARACTER;
+    return 1;
+}
+
+size_t utf8_encode(const wchar_t* source, size_t length, char* destination) {
+    const wchar_t* end = source + length;
+    unsigned char* output = (unsigned char*)destination;
+
+    for (const wchar_t* id = source; id < end; id++) {
+        uint32_t value = (uint32_t)*id;
+        if (value < 0x80) {
+            *(output++) = (unsigned char)value;
+            continue;
+        }
+
+        if (value > 0x10FFFF || (0xD800 <= value && value <= 0xDFFF)) value = UTF8_REPLACEMENT_CHARACTER;
+
+        if (value < 0x800) {
+            *(output++) = 0xC0 | (value >> 6);
+        } else if (value < 0x10000) {
+            *(output++) = 0xE0 | (value >> 12);
+            *(output++) = 0x80 | ((value >> 6) & 0x3F);
+        } else {
+            *(output++) = 0xF0 | (value >> 18);
+            *(output++) = 0x80 | ((value >> 12) & 0x3F);
+            *(output++) = 0x80 | ((value >> 6) & 0x3F);
+        }
+        *(output++) = 0x80 | (value & 0x3F);
+    }
+
+    return (char*)output - destination;
+}
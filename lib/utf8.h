@@ -0,0 +1,71 @@
+/**
+ * @file utf8.h
+ * @author Ilya Kudryashov (kudriashov.it@phystech.edu)
+ * @brief Bulk UTF-8 <-> wide character conversion.
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <cstddef>
+#include <wchar.h>
+
+/**
+ * @brief Character put in place of every byte that does not start a valid UTF-8 sequence.
+ */
+static const wchar_t UTF8_REPLACEMENT_CHARACTER = 0xFFFD;
+
+/**
+ * @brief Decode UTF-8 byte sequence into wide characters.
+ *
+ * Runs of ASCII bytes are copied 8 at a time, invalid bytes are replaced with UTF8_REPLACEMENT_CHARACTER.
+ *
+ * @param[in] source bytes to decode
+ * @param[in] length number of bytes to decode
+ * @param[out] destination buffer with space for at least length characters
+ * @return size_t number of decoded characters
+ */
+size_t utf8_decode(const char* source, size_t length, wchar_t* destination);
+
+/**
+ * @brief Decode the character starting at source as utf8_decode() would.
+ *
+ * @param[in] source start of the character
+ * @param[in] end end of the input
+ * @param[out] character decoded character
+ * @return size_t number of bytes the character takes
+ */
+size_t utf8_next(const char* source, const char* end, wchar_t* character);
+
+/**
+ * @brief Decode the character ending right before end, so valid characters are found exactly where
+ * utf8_decode() finds them and every byte of invalid sequence is a separate UTF8_REPLACEMENT_CHARACTER.
+ *
+ * @param[in] begin start of the input
+ * @param[in] end end of the character
+ * @param[out] character decoded character
+ * @return size_t number of bytes the character takes
+ */
+size_t utf8_previous(const char* begin, const char* end, wchar_t* character);
+
+/**
+ * @brief Maximum number of bytes single character can take in UTF-8.
+ */
+static const size_t UTF8_MAX_SEQUENCE_LENGTH = 4;
+
+/**
+ * @brief Encode wide characters as UTF-8.
+ *
+ * @param[in] source characters to encode
+ * @param[in] length number of characters to encode
+ * @param[out] destination buffer with space for at least length * UTF8_MAX_SEQUENCE_LENGTH bytes
+ * @return size_t number of bytes written
+ */
+size_t utf8_encode(const wchar_t* source, size_t length, char* destination);
+
+#endif
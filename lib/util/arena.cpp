@@ -0,0 +1,189 @@
+#include "arena.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "dbg/debug.h"
+#include "dbg/profiler.h"
+
+static const size_t ARENA_ALIGNMENT = alignof(max_align_t);
+static const size_t MIN_ARENA_BLOCK_SIZE = 1 << 20;
+
+/**
+ * @brief Chunk of memory allocations are taken from, its data follows the header.
+ *
+ * @param previous block allocated before this one
+ * @param size number of bytes in the block
+ * @param used number of bytes given away
+ * @param step size of the last geometrically grown block, the next one is twice as large
+ */
+struct alignas(max_align_t) ArenaBlock {
+    ArenaBlock* previous;
+    size_t size;
+    size_t used;
+    size_t step;
+};
+
+static_assert(sizeof(ArenaBlock) % alignof(max_align_t) == 0, "Data of the block has to stay aligned");
+
+/**
+ * @brief Get first byte of the block data.
+ */
+static inline char* block_data(ArenaBlock* block) {
+    return (char*)(block + 1);
+}
+
+/**
+ * @brief Round the size up to the alignment of allocations.
+ */
+static inline size_t align_size(size_t size) {
+    return (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+}
+
+void* arena_alloc(Arena* arena, size_t size, int* error_code) {
+    _LOG_FAIL_CHECK_(arena, "error", ERROR_REPORTS, return NULL;, error_code, EFAULT);
+    size = align_size(size ? size : 1);
+
+    pthread_mutex_lock(&arena->lock);
+
+    ArenaBlock* block = arena->block;
+    bool new_block_taken = !block || block->size - block->used < size;
+    if (new_block_taken) {
+        //* Small allocations get geometrically growing blocks, large ones get blocks of their own size,
+        //* so a buffer of the whole text never leaves a block of the same size unused after it.
+        size_t block_size = arena->reserved;
+        if (block && block_size < 2 * block->step) block_size = 2 * block->step;
+        if (block_size < MIN_ARENA_BLOCK_SIZE) block_size = MIN_ARENA_BLOCK_SIZE;
+
+        size_t step = block_size;
+        bool exact = 2 * size >= block_size;
+        if (exact) {
+            block_size = size;
+            step = block ? block->step : 0;
+        }
+
+        ArenaBlock* new_block = (ArenaBlock*)malloc(sizeof(ArenaBlock) + block_size);
+        if (!new_block) {
+            pthread_mutex_unlock(&arena->lock);
+            log_printf(ERROR_REPORTS, "error", "Failed to allocate arena block of %zu bytes.\n", block_size);
+            if (error_code) *error_code = ENOMEM;
+            return NULL;
+        }
+
+        *new_block = {block, block_size, 0, step};
+        arena->block = block = new_block;
+        if (!exact) arena->reserved = 0;
+    }
+
+    void* pointer = block_data(block) + block->used;
+    block->used += size;
+
+    pthread_mutex_unlock(&arena->lock);
+
+    if (new_block_taken) _PROFILE_HEAP_();
+    return pointer;
+}
+
+void arena_release(Arena* arena, void* pointer, size_t size) {
+    if (!arena || !pointer) return;
+    size = align_size(size ? size : 1);
+
+    pthread_mutex_lock(&arena->lock);
+
+    ArenaBlock* block = arena->block;
+    if (block && (char*)pointer + size == block_data(block) + block->used) {
+        block->used -= size;
+
+        //* Emptied block is dropped, so the allocation below it becomes the top one and can be released too.
+        if (!block->used && block->previous) {
+            arena->block = block->previous;
+            free(block);
+        }
+    }
+
+    pthread_mutex_unlock(&arena->lock);
+}
+
+void* arena_resize(Arena* arena, void* pointer, size_t size, size_t new_size, int* error_code) {
+    _LOG_FAIL_CHECK_(arena, "error", ERROR_REPORTS, return NULL;, error_code, EFAULT);
+    if (!pointer) return arena_alloc(arena, new_size, error_code);
+
+    size_t old_space = align_size(size ? size : 1);
+    size_t new_space = align_size(new_size ? new_size : 1);
+
+    pthread_mutex_lock(&arena->lock);
+
+    ArenaBlock* block = arena->block;
+    if (block && (char*)pointer + old_space == block_data(block) + block->used &&
+        (new_space <= old_space || new_space - old_space <= block->size - block->used)) {
+        block->used = block->used - old_space + new_space;
+        pthread_mutex_unlock(&arena->lock);
+        return pointer;
+    }
+
+    pthread_mutex_unlock(&arena->lock);
+
+    if (new_space <= old_space) return pointer;
+
+    void* new_pointer = arena_alloc(arena, new_size, error_code);
+    if (new_pointer) memcpy(new_pointer, pointer, size);
+    return new_pointer;
+}
+
+void arena_reset(Arena* arena) {
+    if (!arena) return;
+
+    pthread_mutex_lock(&arena->lock);
+
+    if (arena->block && !arena->block->previous) {
+        arena->block->used = 0;
+    } else if (arena->block) {
+        //* Several blocks are merged into one, allocated lazily as the next input may be empty.
+        size_t total_size = 0;
+        while (ArenaBlock* block = arena->block) {
+            total_size += block->size;
+            arena->block = block->previous;
+            free(block);
+        }
+        arena->reserved = total_size;
+    }
+
+    pthread_mutex_unlock(&arena->lock);
+}
+
+void arena_destroy(Arena* arena) {
+    if (!arena) return;
+
+    pthread_mutex_lock(&arena->lock);
+
+    while (ArenaBlock* block = arena->block) {
+        arena->block = block->previous;
+        free(block);
+    }
+    arena->reserved = 0;
+
+    pthread_mutex_unlock(&arena->lock);
+}
+
+void* arena_or_heap_alloc(Arena* arena, size_t size) {
+    if (arena) return arena_alloc(arena, size);
+
+    void* pointer = malloc(size);
+    _PROFILE_HEAP_();
+    return pointer;
+}
+
+void* arena_or_heap_resize(Arena* arena, void* pointer, size_t size, size_t new_size) {
+    if (arena) return arena_resize(arena, pointer, size, new_size);
+
+    void* new_pointer = realloc(pointer, new_size);
+    if (new_size > size) _PROFILE_HEAP_();
+    return new_pointer;
+}
+
+void arena_or_heap_free(Arena* arena, void* pointer, size_t size) {
+    if (arena) arena_release(arena, pointer, size);
+    else       free(pointer);
+}
@@ -0,0 +1,112 @@
+/**
+ * @file arena.h
+ * @author Ilya Kudryashov (kudriashov.it@phystech.edu)
+ * @brief Region allocator for buffers that live until the whole input is processed.
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+struct ArenaBlock;
+
+/**
+ * @brief Region memory is taken from by moving a pointer, freed all at once by arena_reset().
+ *
+ * Memory is neither zeroed nor returned to the system between inputs: after a reset the next
+ * input gets a single block as large as all blocks of the previous one together.
+ *
+ * @param block block allocations are taken from (points to the older ones)
+ * @param reserved size of the block to allocate on the first allocation after a reset
+ * @param lock mutex guarding the arena, so threads of the pool may share it
+ */
+struct Arena {
+    ArenaBlock* block = NULL;
+    size_t reserved = 0;
+    pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+};
+
+/**
+ * @brief Allocate uninitialized memory from the arena.
+ *
+ * @param arena arena to allocate from
+ * @param size number of bytes
+ * @param error_code where to put error codes
+ * @return void* pointer aligned as malloc() aligns it or NULL if memory could not be allocated
+ */
+void* arena_alloc(Arena* arena, size_t size, int* error_code = NULL);
+
+/**
+ * @brief Give the memory back to the arena if nothing was allocated after it, do nothing otherwise.
+ *
+ * @param arena arena the memory was allocated from
+ * @param pointer pointer returned by arena_alloc()
+ * @param size size it was allocated with
+ */
+void arena_release(Arena* arena, void* pointer, size_t size);
+
+/**
+ * @brief Change size of the allocation, in place if nothing was allocated after it and its block has room.
+ *
+ * Moved allocation leaves its old memory to the arena until the next reset.
+ *
+ * @param arena arena the memory was allocated from
+ * @param pointer pointer returned by arena_alloc() (NULL to allocate)
+ * @param size size it was allocated with
+ * @param new_size number of bytes it has to have
+ * @param error_code where to put error codes
+ * @return void* pointer to the allocation or NULL if memory could not be allocated (old one stays valid)
+ */
+void* arena_resize(Arena* arena, void* pointer, size_t size, size_t new_size, int* error_code = NULL);
+
+/**
+ * @brief Free all allocations of the arena at once keeping its memory for the next input.
+ *
+ * @param arena arena to reset
+ */
+void arena_reset(Arena* arena);
+
+/**
+ * @brief Return memory of the arena to the system.
+ *
+ * @param arena arena to destroy
+ */
+void arena_destroy(Arena* arena);
+
+/**
+ * @brief Allocate from the arena or from the heap if there is no arena.
+ *
+ * @param arena arena to allocate from (may be NULL)
+ * @param size number of bytes
+ * @return void* pointer or NULL if memory could not be allocated
+ */
+void* arena_or_heap_alloc(Arena* arena, size_t size);
+
+/**
+ * @brief Resize memory allocated by arena_or_heap_alloc() as arena_resize() or realloc() does.
+ *
+ * @param arena arena the memory was allocated from (may be NULL)
+ * @param pointer pointer to resize
+ * @param size size it was allocated with
+ * @param new_size number of bytes it has to have
+ * @return void* pointer to the allocation or NULL if memory could not be allocated (old one stays valid)
+ */
+void* arena_or_heap_resize(Arena* arena, void* pointer, size_t size, size_t new_size);
+
+/**
+ * @brief Free memory allocated by arena_or_heap_alloc().
+ *
+ * @param arena arena the memory was allocated from (may be NULL)
+ * @param pointer pointer to free
+ * @param size size it was allocated with
+ */
+void arena_or_heap_free(Arena* arena, void* pointer, size_t size);
+
+#endif
@@ -57,6 +57,10 @@ void edit_string(const int argc, void** argv, const char* argument) {
     strcpy(*(char**)argv, argument);
 }
 
+void edit_flag(const int argc, void** argv, const char* argument) {
+    *(bool*)argv[0] = true;
+}
+
 void print_description(const ActionTag& tag) {
     if (*tag.name.long_name)
         printf("-%c --%s - %s\n\n", tag.name.short_name, tag.name.long_name, tag.description);
@@ -0,0 +1,153 @@
+#include "bytescan.h"
+
+#include <stddef.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BYTESCAN_X86
+#endif
+
+/**
+ * @brief Scalar version of find_byte(), used for tails and unsupported architectures.
+ */
+static inline const char* find_byte_scalar(const char* begin, const char* end, const char byte) {
+    while (begin < end && *begin != byte) begin++;
+    return begin;
+}
+
+/**
+ * @brief Scalar version of is_ascii(), used for tails and unsupported architectures.
+ */
+static inline bool is_ascii_scalar(const char* begin, const char* end) {
+    unsigned char accumulated = 0;
+    for (; begin < end; begin++) accumulated |= (unsigned char)*begin;
+    return accumulated < 0x80;
+}
+
+/**
+ * @brief Scalar version of common_prefix_length(), used for tails and unsupported architectures.
+ */
+static inline size_t common_prefix_length_scalar(const wchar_t* a, const wchar_t* b, size_t length, bool reverse) {
+    ptrdiff_t step = reverse ? -1 : 1;
+    size_t matched = 0;
+    for (; matched < length && *a == *b; matched++, a += step, b += step) {}
+    return matched;
+}
+
+#ifdef BYTESCAN_X86
+
+__attribute__((target("sse2")))
+static const char* find_byte_sse2(const char* begin, const char* end, const char byte) {
+    const __m128i pattern = _mm_set1_epi8(byte);
+    for (; end - begin >= 16; begin += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*)begin);
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, pattern));
+        if (mask) return begin + __builtin_ctz(mask);
+    }
+    return find_byte_scalar(begin, end, byte);
+}
+
+__attribute__((target("avx2")))
+static const char* find_byte_avx2(const char* begin, const char* end, const char byte) {
+    const __m256i pattern = _mm256_set1_epi8(byte);
+    for (; end - begin >= 32; begin += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i*)begin);
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, pattern));
+        if (mask) return begin + __builtin_ctz(mask);
+    }
+    return find_byte_sse2(begin, end, byte);
+}
+
+__attribute__((target("sse2")))
+static bool is_ascii_sse2(const char* begin, const char* end) {
+    __m128i accumulated = _mm_setzero_si128();
+    for (; end - begin >= 16; begin += 16) {
+        accumulated = _mm_or_si128(accumulated, _mm_loadu_si128((const __m128i*)begin));
+    }
+    return !_mm_movemask_epi8(accumulated) && is_ascii_scalar(begin, end);
+}
+
+__attribute__((target("avx2")))
+static bool is_ascii_avx2(const char* begin, const char* end) {
+    //* High bits are only collected inside the loop, one movemask per 4 KiB lets it stop early on non-ASCII input.
+    const ptrdiff_t stride = 4096;
+    while (end - begin >= stride) {
+        __m256i accumulated = _mm256_setzero_si256();
+        for (const char* block = begin; block < begin + stride; block += 32) {
+            accumulated = _mm256_or_si256(accumulated, _mm256_loadu_si256((const __m256i*)block));
+        }
+        if (_mm256_movemask_epi8(accumulated)) return false;
+        begin += stride;
+    }
+    return is_ascii_sse2(begin, end);
+}
+
+__attribute__((target("sse2")))
+static size_t common_prefix_length_sse2(const wchar_t* a, const wchar_t* b, size_t length, bool reverse) {
+    //* In reverse the block ends at the current character, so the prefix is counted from the highest lane.
+    const ptrdiff_t offset = reverse ? -3 : 0;
+    const ptrdiff_t step = reverse ? -4 : 4;
+    size_t matched = 0;
+    for (; length - matched >= 4; matched += 4, a += step, b += step) {
+        __m128i block_a = _mm_loadu_si128((const __m128i*)(a + offset));
+        __m128i block_b = _mm_loadu_si128((const __m128i*)(b + offset));
+        unsigned mismatch = ~(unsigned)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(block_a, block_b))) & 0xF;
+        if (mismatch) return matched + (reverse ? __builtin_clz(mismatch) - 28 : __builtin_ctz(mismatch));
+    }
+    return matched + common_prefix_length_scalar(a, b, length - matched, reverse);
+}
+
+__attribute__((target("avx2")))
+static size_t common_prefix_length_avx2(const wchar_t* a, const wchar_t* b, size_t length, bool reverse) {
+    const ptrdiff_t offset = reverse ? -7 : 0;
+    const ptrdiff_t step = reverse ? -8 : 8;
+    size_t matched = 0;
+    for (; length - matched >= 8; matched += 8, a += step, b += step) {
+        __m256i block_a = _mm256_loadu_si256((const __m256i*)(a + offset));
+        __m256i block_b = _mm256_loadu_si256((const __m256i*)(b + offset));
+        unsigned mismatch = ~(unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(block_a, block_b))) & 0xFF;
+        if (mismatch) return matched + (reverse ? __builtin_clz(mismatch) - 24 : __builtin_ctz(mismatch));
+    }
+    return matched + common_prefix_length_sse2(a, b, length - matched, reverse);
+}
+
+/**
+ * @brief Check if the processor supports AVX2 (called before main(), so cpu info has to be initialized manually).
+ */
+static bool detect_avx2() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+static const bool HAS_AVX2 = detect_avx2();
+
+const char* find_byte(const char* begin, const char* end, const char byte) {
+    if (HAS_AVX2) return find_byte_avx2(begin, end, byte);
+    return find_byte_sse2(begin, end, byte);
+}
+
+bool is_ascii(const char* begin, const char* end) {
+    if (HAS_AVX2) return is_ascii_avx2(begin, end);
+    return is_ascii_sse2(begin, end);
+}
+
+size_t common_prefix_length(const wchar_t* a, const wchar_t* b, size_t length, bool reverse) {
+    if (HAS_AVX2) return common_prefix_length_avx2(a, b, length, reverse);
+    return common_prefix_length_sse2(a, b, length, reverse);
+}
+
+#else
+
+const char* find_byte(const char* begin, const char* end, const char byte) {
+    return find_byte_scalar(begin, end, byte);
+}
+
+bool is_ascii(const char* begin, const char* end) {
+    return is_ascii_scalar(begin, end);
+}
+
+size_t common_prefix_length(const wchar_t* a, const wchar_t* b, size_t length, bool reverse) {
+    return common_prefix_length_scalar(a, b, length, reverse);
+}
+
+#endif
@@ -0,0 +1,53 @@
+/**
+ * @file bytescan.h
+ * @author Ilya Kudryashov (kudriashov.it@phystech.edu)
+ * @brief Vectorized search over raw byte and wide character buffers.
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef BYTESCAN_H
+#define BYTESCAN_H
+
+#include <stddef.h>
+
+/**
+ * @brief Find first occurrence of the byte in the buffer.
+ *
+ * Uses AVX2 if the processor supports it, SSE2 otherwise and plain loop on other architectures.
+ *
+ * @param begin start of the buffer
+ * @param end end of the buffer
+ * @param byte byte to look for
+ * @return const char* pointer to the first occurrence or end if there is none
+ */
+const char* find_byte(const char* begin, const char* end, const char byte);
+
+/**
+ * @brief Check if all bytes of the buffer are ASCII (below 0x80).
+ *
+ * Uses AVX2 if the processor supports it, SSE2 otherwise and plain loop on other architectures.
+ *
+ * @param begin start of the buffer
+ * @param end end of the buffer
+ * @return bool true if there are no bytes with the high bit set
+ */
+bool is_ascii(const char* begin, const char* end);
+
+/**
+ * @brief Count equal characters at the start of two wide strings.
+ *
+ * Uses AVX2 if the processor supports it, SSE2 otherwise and plain loop on other architectures.
+ *
+ * @param a first string (its last character if reverse is set)
+ * @param b second string (its last character if reverse is set)
+ * @param length number of characters available in both strings
+ * @param reverse walk towards lower addresses
+ * @return size_t length of the common prefix (common suffix if reverse is set)
+ */
+size_t common_prefix_length(const wchar_t* a, const wchar_t* b, size_t length, bool reverse);
+
+#endif
@@ -1,16 +1,80 @@
 #include "logger.h"
 
 #include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
 #include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <atomic>
 
 #include "debug.h"
 
-static FILE* logfile = NULL;
+static std::atomic<FILE*> logfile = {NULL};
+//* Synchronous writers, the logging thread and log_close() take turns on the file, so no message
+//* is split by another one and nobody writes to the file after it is closed.
+static pthread_mutex_t file_lock = PTHREAD_MUTEX_INITIALIZER;
 static unsigned int log_threshold = 0;
 
+static const size_t LOG_RING_SIZE = 1 << 16;
+static const size_t LOG_MESSAGE_SIZE = 4096;
+static const size_t LOG_FILE_BUFFER_SIZE = 1 << 16;
+static const long LOG_DRAIN_INTERVAL_NS = 10 * 1000 * 1000;
+static const size_t LOG_TIMESTAMP_SIZE = 32;
+
+/**
+ * @brief Ring buffer of messages written by a single thread and read by the logging thread.
+ *
+ * Every message is stored as its length (uint32_t) followed by its characters.
+ *
+ * @param data message bytes
+ * @param head number of bytes ever written (advanced by the owner thread)
+ * @param tail number of bytes ever read (advanced by the logging thread)
+ * @param retired set when the owner thread exits, the logging thread frees the ring once it is empty
+ * @param next next ring in the list of all rings
+ */
+struct LogRing {
+    char data[LOG_RING_SIZE];
+    std::atomic<size_t> head = {0};
+    std::atomic<size_t> tail = {0};
+    std::atomic<bool> retired = {false};
+    LogRing* next = NULL;
+};
+
+/**
+ * @brief Ring of the current thread, valid while generation matches the one of the logger.
+ *
+ * Ring is retired when the thread exits, so short-lived threads do not leave their rings behind.
+ * Thread that started the logger keeps its ring until log_stop_async(): it still logs while
+ * the program exits, after its thread_local objects are destroyed.
+ *
+ * @param ring ring of the thread
+ * @param generation generation of the logger the ring belongs to
+ * @param owner set for the thread that started the logger
+ */
+struct ThreadRing {
+    LogRing* ring = NULL;
+    unsigned long generation = 0;
+    bool owner = false;
+
+    ~ThreadRing();
+};
+
+static std::atomic<bool> async_logging = {false};
+//* Threads that may be touching the rings, log_stop_async() waits for them before the rings are freed.
+static std::atomic<int> active_producers = {0};
+static std::atomic<LogRing*> log_rings = {NULL};
+static unsigned long log_generation = 0;
+static bool drain_stop = false;
+static pthread_t drain_thread;
+static pthread_mutex_t drain_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t drain_wakeup = PTHREAD_COND_INITIALIZER;
+
+static thread_local ThreadRing thread_ring;
+
 /**
  * @brief Prints out log line prefix (time and tag).
- * 
+ *
  * @param tag (optional) prefix tag
  * @param importance (optional) message importance
  */
@@ -18,13 +82,27 @@ static void log_prefix(const char* tag = "status", const unsigned int importance
 
 /**
  * @brief Returns currently opened log file by given importance.
- * 
+ *
  * @param importance (optional) importance of the message file will be used for.
- * 
+ *
  * @return FILE* log file
  */
 static FILE* log_file(const unsigned int importance = ABSOLUTE_IMPORTANCE);
 
+/**
+ * @brief Format message with its prefix and put it into the ring of the current thread.
+ *
+ * @param tag message tag
+ * @param format format string for printf()
+ * @param args arguments for printf()
+ */
+static void log_push(const char* tag, const char* format, va_list args);
+
+/**
+ * @brief Main loop of the logging thread.
+ */
+static void* log_drain_loop(void*);
+
 void log_init(const char* filename, const unsigned int threshold, int* error_code) {
     log_threshold = threshold;
 
@@ -37,17 +115,46 @@ void log_init(const char* filename, const unsigned int threshold, int* error_cod
     if (error_code) *error_code = FILE_ERROR;
 }
 
+void log_start_async(int* error_code) {
+    if (!logfile || async_logging) return;
+
+    drain_stop = false;
+    log_generation++;
+    thread_ring.owner = true;
+
+    if (pthread_create(&drain_thread, NULL, log_drain_loop, NULL)) {
+        if (error_code) *error_code = FILE_ERROR;
+        return;
+    }
+
+    async_logging = true;
+}
+
+/**
+ * @brief Get timestamp of the current second formatted as by asctime().
+ *
+ * Timestamp is formatted again only when the second changes.
+ */
+static const char* log_timestamp() {
+    static thread_local time_t cached_time = 0;
+    static thread_local char cached_timestamp[LOG_TIMESTAMP_SIZE] = "";
+
+    time_t rawtime = time(NULL);
+    if (rawtime != cached_time || !*cached_timestamp) {
+        struct tm timeinfo = {};
+        localtime_r(&rawtime, &timeinfo);
+        asctime_r(&timeinfo, cached_timestamp);
+        cached_timestamp[strlen(cached_timestamp) - 1] = '\0';
+        cached_time = rawtime;
+    }
+
+    return cached_timestamp;
+}
+
 static void log_prefix(const char* tag, const unsigned int importance) {
     if (!log_file()) return;
-    time_t rawtime;
-    struct tm * timeinfo;
-
-    time(&rawtime);
-    timeinfo = localtime (&rawtime);
-    char* pc_timestamp = asctime(timeinfo);
-    pc_timestamp[strlen(pc_timestamp) - 1] = '\0';
 
-    fprintf(log_file(importance), "%-20s [%s]:  ", pc_timestamp, tag);
+    fprintf(log_file(importance), "%-20s [%s]:  ", log_timestamp(), tag);
 }
 
 void _log_printf(const unsigned int importance, const char* tag, const char* format, ...) {
@@ -55,22 +162,246 @@ void _log_printf(const unsigned int importance, const char* tag, const char* for
     va_start(args, format);
 
     if (importance >= log_threshold && logfile) {
-        log_prefix(tag, importance);
-        vfprintf(log_file(importance), format, args);
-        fflush(log_file(importance));
+        //* Producer is counted before the mode is checked again, so the logger cannot stop between the check
+        //* and the push. Synchronous writers are not counted, so they never keep log_stop_async() waiting.
+        bool pushed = false;
+        if (async_logging) {
+            active_producers++;
+            if (async_logging) {
+                log_push(tag, format, args);
+                pushed = true;
+            }
+            active_producers--;
+        }
+
+        if (!pushed) {
+            pthread_mutex_lock(&file_lock);
+            if (logfile) {
+                log_prefix(tag, importance);
+                vfprintf(log_file(importance), format, args);
+                fflush(log_file(importance));
+            }
+            pthread_mutex_unlock(&file_lock);
+        }
     }
 
     va_end(args);
 }
 
 static FILE* log_file(const unsigned int importance) {
-    return importance >= log_threshold ? logfile : NULL;
+    return importance >= log_threshold ? logfile.load() : NULL;
+}
+
+/**
+ * @brief Get ring of the current thread creating it on the first call.
+ */
+static LogRing* get_thread_ring() {
+    if (thread_ring.ring && thread_ring.generation == log_generation) return thread_ring.ring;
+
+    LogRing* ring = new LogRing;
+    ring->next = log_rings.load();
+    while (!log_rings.compare_exchange_weak(ring->next, ring)) {}
+
+    thread_ring.ring = ring;
+    thread_ring.generation = log_generation;
+    return ring;
+}
+
+ThreadRing::~ThreadRing() {
+    if (owner || !ring) return;
+
+    active_producers++;
+    if (async_logging && generation == log_generation) ring->retired.store(true, std::memory_order_release);
+    ring = NULL;
+    active_producers--;
+}
+
+/**
+ * @brief Wake the logging thread up before its next scheduled drain.
+ */
+static void log_wake_drain() {
+    pthread_mutex_lock(&drain_lock);
+    pthread_cond_signal(&drain_wakeup);
+    pthread_mutex_unlock(&drain_lock);
+}
+
+static void log_push(const char* tag, const char* format, va_list args) {
+    char message[LOG_MESSAGE_SIZE] = "";
+    int prefix_length = snprintf(message, sizeof(message), "%-20s [%s]:  ", log_timestamp(), tag);
+    if (prefix_length < 0) return;
+    if ((size_t)prefix_length >= sizeof(message)) prefix_length = sizeof(message) - 1;
+
+    int body_length = vsnprintf(message + prefix_length, sizeof(message) - prefix_length, format, args);
+    if (body_length < 0) body_length = 0;
+
+    uint32_t length = prefix_length + body_length;
+    if (length >= sizeof(message)) length = sizeof(message) - 1;
+
+    LogRing* ring = get_thread_ring();
+    size_t head = ring->head.load(std::memory_order_relaxed);
+    size_t needed = sizeof(length) + length;
+
+    //* Messages are never dropped, the thread waits for the logging thread if the ring is full.
+    while (LOG_RING_SIZE - (head - ring->tail.load(std::memory_order_acquire)) < needed) {
+        log_wake_drain();
+        sched_yield();
+    }
+
+    const char* parts[2] = {(const char*)&length, message};
+    size_t part_lengths[2] = {sizeof(length), length};
+    for (int part_id = 0; part_id < 2; part_id++) {
+        size_t start = head % LOG_RING_SIZE;
+        size_t first = part_lengths[part_id] < LOG_RING_SIZE - start ? part_lengths[part_id] : LOG_RING_SIZE - start;
+        memcpy(ring->data + start, parts[part_id], first);
+        memcpy(ring->data, parts[part_id] + first, part_lengths[part_id] - first);
+        head += part_lengths[part_id];
+    }
+
+    ring->head.store(head, std::memory_order_release);
+}
+
+/**
+ * @brief Copy bytes out of the ring.
+ */
+static void ring_read(const LogRing* ring, size_t position, char* destination, size_t length) {
+    size_t start = position % LOG_RING_SIZE;
+    size_t first = length < LOG_RING_SIZE - start ? length : LOG_RING_SIZE - start;
+    memcpy(destination, ring->data + start, first);
+    memcpy(destination + first, ring->data, length - first);
+}
+
+/**
+ * @brief Write the block of messages to the log file.
+ */
+static void log_write(const char* data, size_t size) {
+    pthread_mutex_lock(&file_lock);
+    fwrite(data, 1, size, logfile);
+    pthread_mutex_unlock(&file_lock);
+}
+
+/**
+ * @brief Unlink the retired ring from the list and free it.
+ *
+ * Producers only push new rings to the front of the list, so a ring is unlinked from the front
+ * only if nothing was pushed in front of it meanwhile (otherwise it is freed by the next drain).
+ *
+ * @return LogRing* ring that is now before the next one
+ */
+static LogRing* free_ring(LogRing* previous, LogRing* ring) {
+    if (previous) {
+        previous->next = ring->next;
+    } else {
+        LogRing* expected = ring;
+        if (!log_rings.compare_exchange_strong(expected, ring->next)) return ring;
+    }
+
+    delete ring;
+    return previous;
+}
+
+/**
+ * @brief Write all messages from all rings into the log file and free the rings of the threads that exited.
+ *
+ * Log file stays unbuffered, so messages are gathered into large blocks here.
+ */
+static void log_drain() {
+    static char output[LOG_FILE_BUFFER_SIZE] = "";
+    size_t filled = 0;
+
+    LogRing* previous = NULL;
+    for (LogRing* ring = log_rings.load(); ring; ) {
+        //* Owner stores its last head before retiring the ring, so the head read after the flag is final.
+        bool retired = ring->retired.load(std::memory_order_acquire);
+        size_t tail = ring->tail.load(std::memory_order_relaxed);
+        size_t head = ring->head.load(std::memory_order_acquire);
+
+        while (tail < head) {
+            uint32_t length = 0;
+            ring_read(ring, tail, (char*)&length, sizeof(length));
+
+            if (filled + length > sizeof(output)) {
+                log_write(output, filled);
+                filled = 0;
+            }
+
+            ring_read(ring, tail + sizeof(length), output + filled, length);
+            filled += length;
+            tail += sizeof(length) + length;
+        }
+
+        ring->tail.store(tail, std::memory_order_release);
+
+        LogRing* next = ring->next;
+        previous = retired ? free_ring(previous, ring) : ring;
+        ring = next;
+    }
+
+    if (filled) log_write(output, filled);
+}
+
+static void* log_drain_loop(void*) {
+    pthread_mutex_lock(&drain_lock);
+    while (!drain_stop) {
+        pthread_mutex_unlock(&drain_lock);
+        log_drain();
+        pthread_mutex_lock(&drain_lock);
+
+        if (drain_stop) break;
+
+        struct timespec deadline = {};
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += LOG_DRAIN_INTERVAL_NS;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&drain_wakeup, &drain_lock, &deadline);
+    }
+    pthread_mutex_unlock(&drain_lock);
+
+    //* Producers are done by the time the logger stops (see log_stop_async()), this drain takes whatever they left.
+    log_drain();
+    return NULL;
+}
+
+/**
+ * @brief Drain all rings, stop the logging thread and return to synchronous logging.
+ */
+static void log_stop_async() {
+    if (!async_logging) return;
+
+    //* New messages are written synchronously from now on, messages being pushed are still drained,
+    //* so producers waiting for space in their rings finish before the logging thread stops.
+    async_logging = false;
+    while (active_producers) {
+        log_wake_drain();
+        sched_yield();
+    }
+
+    pthread_mutex_lock(&drain_lock);
+    drain_stop = true;
+    pthread_cond_signal(&drain_wakeup);
+    pthread_mutex_unlock(&drain_lock);
+
+    pthread_join(drain_thread, NULL);
+
+    LogRing* ring = log_rings.exchange(NULL);
+    while (ring) {
+        LogRing* next = ring->next;
+        delete ring;
+        ring = next;
+    }
 }
 
 void log_close(int* error_code) {
     if (!log_file()) return;
     log_printf(ABSOLUTE_IMPORTANCE, "close", "Closing log file.\n\n");
-    if (!fclose(logfile)) {
+    log_stop_async();
+
+    pthread_mutex_lock(&file_lock);
+    if (fclose(logfile)) {
         if (error_code) *error_code = FILE_ERROR;
     }
-}
\ No newline at end of file
+    logfile = NULL;
+    pthread_mutex_unlock(&file_lock);
+}
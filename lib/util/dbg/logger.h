@@ -59,6 +59,16 @@ enum IMPORTANCES {
  */
 void log_init(const char* filename = "log", const unsigned int threshold = 0, int* error_code = NULL);
 
+/**
+ * @brief Switch logger to asynchronous mode.
+ *
+ * Messages are formatted into a ring buffer of the calling thread and written to the log file
+ * by a background thread. log_close() writes all of them before closing the file.
+ *
+ * @param error_code (optional) variable to put function execution code in
+ */
+void log_start_async(int* error_code = NULL);
+
 /**
  * @brief Print line to logs with automatic prefix.
  * 
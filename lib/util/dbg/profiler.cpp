@@ -0,0 +1,138 @@
+#include "profiler.h"
+
+#include <string.h>
+#include <time.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sys/resource.h>
+
+#include "debug.h"
+
+/**
+ * @brief Accumulated time of the phase.
+ *
+ * @param name name of the phase
+ * @param seconds total time spent in the phase
+ * @param calls number of times the phase was entered
+ */
+struct ProfilePhase {
+    const char* name;
+    double seconds;
+    unsigned long calls;
+};
+
+static const int MAX_PROFILE_PHASES = 64;
+
+static const char* const COUNTER_NAMES[NUMBER_OF_PROFILE_COUNTERS] = {
+    "compare_keys_calls",
+    "key_char_comparisons",
+    "bytes_read",
+    "bytes_written",
+};
+
+bool profiler_enabled = false;
+std::atomic<unsigned long long> profile_counters[NUMBER_OF_PROFILE_COUNTERS] = {};
+
+static ProfilePhase phases[MAX_PROFILE_PHASES] = {};
+static int phase_count = 0;
+static std::atomic<size_t> peak_heap = {0};
+static pthread_mutex_t phases_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Get number of bytes currently allocated on the heap.
+ */
+static size_t heap_in_use() {
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+void profiler_enable() {
+    profiler_enabled = true;
+    peak_heap = heap_in_use();
+}
+
+void profiler_sample_heap() {
+    size_t heap = heap_in_use();
+    size_t peak = peak_heap.load(std::memory_order_relaxed);
+    while (heap > peak && !peak_heap.compare_exchange_weak(peak, heap, std::memory_order_relaxed)) {}
+}
+
+double profiler_time() {
+    struct timespec moment = {};
+    clock_gettime(CLOCK_MONOTONIC, &moment);
+    return (double)moment.tv_sec + (double)moment.tv_nsec * 1e-9;
+}
+
+PhaseTimer::PhaseTimer(const char* phase_name) : name(phase_name), start(0) {
+    if (profiler_enabled) start = profiler_time();
+}
+
+PhaseTimer::~PhaseTimer() {
+    if (!profiler_enabled || !start) return;
+    double elapsed = profiler_time() - start;
+
+    //* Large allocations sample the heap themselves, phase ends catch the rest.
+    profiler_sample_heap();
+
+    pthread_mutex_lock(&phases_lock);
+
+    int phase_id = 0;
+    while (phase_id < phase_count && strcmp(phases[phase_id].name, name)) phase_id++;
+
+    if (phase_id == phase_count && phase_count < MAX_PROFILE_PHASES) phases[phase_count++] = {name, 0, 0};
+
+    if (phase_id < phase_count) {
+        phases[phase_id].seconds += elapsed;
+        phases[phase_id].calls++;
+    }
+
+    pthread_mutex_unlock(&phases_lock);
+}
+
+void profiler_report(int format) {
+    if (!profiler_enabled) return;
+
+    struct rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+    size_t peak_resident = (size_t)usage.ru_maxrss << 10;
+
+    pthread_mutex_lock(&phases_lock);
+
+    if (format == PROFILE_JSON) {
+        //* Whole summary is a single log line, so it can be extracted with grep.
+        char summary[4096] = "";
+        size_t length = 0;
+        size_t capacity = sizeof(summary);
+
+        length += snprintf(summary + length, capacity - length, "{\"phases\": [");
+        for (int phase_id = 0; phase_id < phase_count && length < capacity; phase_id++) {
+            length += snprintf(summary + length, capacity - length, "%s{\"name\": \"%s\", \"seconds\": %.6f, \"calls\": %lu}",
+                               phase_id ? ", " : "", phases[phase_id].name, phases[phase_id].seconds,
+                               phases[phase_id].calls);
+        }
+        for (int counter_id = 0; counter_id < NUMBER_OF_PROFILE_COUNTERS && length < capacity; counter_id++) {
+            length += snprintf(summary + length, capacity - length, "%s\"%s\": %llu",
+                               counter_id ? ", " : "], ", COUNTER_NAMES[counter_id],
+                               profile_counters[counter_id].load());
+        }
+        if (length < capacity) {
+            snprintf(summary + length, capacity - length, ", \"peak_heap_bytes\": %zu, \"peak_resident_bytes\": %zu}",
+                     peak_heap.load(), peak_resident);
+        }
+
+        log_printf(ABSOLUTE_IMPORTANCE, "profile", "%s\n", summary);
+    } else {
+        for (int phase_id = 0; phase_id < phase_count; phase_id++) {
+            log_printf(ABSOLUTE_IMPORTANCE, "profile", "Phase %s took %.6f s in %lu call(s).\n",
+                       phases[phase_id].name, phases[phase_id].seconds, phases[phase_id].calls);
+        }
+        for (int counter_id = 0; counter_id < NUMBER_OF_PROFILE_COUNTERS; counter_id++) {
+            log_printf(ABSOLUTE_IMPORTANCE, "profile", "Counter %s is %llu.\n",
+                       COUNTER_NAMES[counter_id], profile_counters[counter_id].load());
+        }
+        log_printf(ABSOLUTE_IMPORTANCE, "profile", "Peak heap usage is %zu bytes, peak resident set is %zu bytes.\n",
+                   peak_heap.load(), peak_resident);
+    }
+
+    pthread_mutex_unlock(&phases_lock);
+}
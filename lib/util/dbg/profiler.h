@@ -0,0 +1,128 @@
+/**
+ * @file profiler.h
+ * @author Ilya Kudryashov (kudriashov.it@phystech.edu)
+ * @brief Module for timing program phases and counting expensive operations.
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+
+/**
+ * @brief List of values counted by the profiler.
+ *
+ * Comparison sorts count whole keys they compare, mkqsort() counts characters it compares
+ * with its pivots and whole keys only when it finishes small ranges by insertion.
+ */
+enum PROFILE_COUNTERS {
+    COMPARE_KEYS_CALLS,
+    KEY_CHAR_COMPARISONS,
+    BYTES_READ,
+    BYTES_WRITTEN,
+    NUMBER_OF_PROFILE_COUNTERS,
+};
+
+/**
+ * @brief Format of the profiler summary.
+ */
+enum PROFILE_FORMATS {
+    PROFILE_TEXT,
+    PROFILE_JSON,
+};
+
+//* Counting stays off until profiler_enable() is called, so counters cost a single branch otherwise.
+extern bool profiler_enabled;
+extern std::atomic<unsigned long long> profile_counters[NUMBER_OF_PROFILE_COUNTERS];
+
+/**
+ * @brief Measures time from its creation to its destruction and adds it to the phase.
+ *
+ * @param name name of the phase (should live until the summary is printed)
+ * @param start moment the timer was created at
+ */
+struct PhaseTimer {
+    const char* name;
+    double start;
+
+    explicit PhaseTimer(const char* phase_name);
+    ~PhaseTimer();
+};
+
+#define _PROFILE_CONCAT_(a, b) a##b
+#define _PROFILE_VARIABLE_(line) _PROFILE_CONCAT_(phase_timer_, line)
+
+#ifndef NPROFILE
+/**
+ * @brief Time the rest of the scope as the phase.
+ *
+ * @param name name of the phase
+ */
+#define _PROFILE_PHASE_(name) PhaseTimer _PROFILE_VARIABLE_(__LINE__)(name)
+
+/**
+ * @brief Add value to the profiler counter.
+ *
+ * @param counter counter from PROFILE_COUNTERS
+ * @param value value to add
+ */
+#define _PROFILE_COUNT_(counter, value) do {                                                 \
+    if (profiler_enabled) profile_counters[counter].fetch_add(value, std::memory_order_relaxed); \
+} while(0)
+
+/**
+ * @brief Sample heap usage right after a large allocation, so the peak is not missed between phases.
+ */
+#define _PROFILE_HEAP_() do {                  \
+    if (profiler_enabled) profiler_sample_heap(); \
+} while(0)
+#else
+/**
+ * @brief (DISABLED) Time the rest of the scope as the phase.
+ *
+ * @param name name of the phase
+ */
+#define _PROFILE_PHASE_(name) do {} while(0)
+
+/**
+ * @brief (DISABLED) Add value to the profiler counter.
+ *
+ * @param counter counter from PROFILE_COUNTERS
+ * @param value value to add
+ */
+#define _PROFILE_COUNT_(counter, value) do {} while(0)
+
+/**
+ * @brief (DISABLED) Sample heap usage right after a large allocation.
+ */
+#define _PROFILE_HEAP_() do {} while(0)
+#endif
+
+/**
+ * @brief Start counting operations and measuring phases.
+ */
+void profiler_enable();
+
+/**
+ * @brief Get current time of the monotonic clock in seconds.
+ */
+double profiler_time();
+
+/**
+ * @brief Update the peak heap usage with the current one.
+ */
+void profiler_sample_heap();
+
+/**
+ * @brief Print phase durations, counters and peak memory usage to logs.
+ *
+ * @param format PROFILE_TEXT for one log line per value, PROFILE_JSON for a single JSON object
+ */
+void profiler_report(int format = PROFILE_TEXT);
+
+#endif
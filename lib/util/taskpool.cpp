@@ -0,0 +1,199 @@
+#include "taskpool.h"
+
+#include <stdlib.h>
+#include <sched.h>
+
+#include "dbg/debug.h"
+
+/**
+ * @brief Argument of the worker thread.
+ */
+struct WorkerArgument {
+    TaskPool* pool;
+    int id;
+};
+
+//* Index of the worker queue of the current thread, threads outside of the pool use queue 0.
+static thread_local const TaskPool* worker_pool = NULL;
+static thread_local int worker_id = 0;
+
+/**
+ * @brief Get queue of the current thread.
+ */
+static inline int own_queue(const TaskPool* pool) {
+    return worker_pool == pool ? worker_id : 0;
+}
+
+/**
+ * @brief Push task to the bottom of the queue.
+ *
+ * @return bool false if the queue is full
+ */
+static bool push_task(TaskQueue* queue, const Task& task) {
+    pthread_mutex_lock(&queue->lock);
+    bool success = queue->bottom - queue->top < TASK_QUEUE_CAPACITY;
+    if (success) queue->tasks[(queue->bottom++) % TASK_QUEUE_CAPACITY] = task;
+    pthread_mutex_unlock(&queue->lock);
+    return success;
+}
+
+/**
+ * @brief Take task from the queue, newest one if from_top is false and oldest one otherwise.
+ *
+ * @param group group the task has to belong to (NULL for any group)
+ * @return bool false if the queue has no such task
+ */
+static bool take_task(TaskQueue* queue, Task* task, bool from_top, const TaskGroup* group) {
+    pthread_mutex_lock(&queue->lock);
+
+    long found = -1;
+    for (long shift = 0; shift < queue->bottom - queue->top && found == -1; shift++) {
+        long id = from_top ? queue->top + shift : queue->bottom - 1 - shift;
+        if (!group || queue->tasks[id % TASK_QUEUE_CAPACITY].group == group) found = id;
+    }
+
+    if (found != -1) {
+        *task = queue->tasks[found % TASK_QUEUE_CAPACITY];
+
+        //* Tasks between the taken one and the end it was searched from close the gap.
+        if (from_top) {
+            for (long id = found; id > queue->top; id--) {
+                queue->tasks[id % TASK_QUEUE_CAPACITY] = queue->tasks[(id - 1) % TASK_QUEUE_CAPACITY];
+            }
+            queue->top++;
+        } else {
+            for (long id = found; id < queue->bottom - 1; id++) {
+                queue->tasks[id % TASK_QUEUE_CAPACITY] = queue->tasks[(id + 1) % TASK_QUEUE_CAPACITY];
+            }
+            queue->bottom--;
+        }
+    }
+
+    pthread_mutex_unlock(&queue->lock);
+    return found != -1;
+}
+
+/**
+ * @brief Take task from the own queue or steal one from other workers.
+ *
+ * @param group group the task has to belong to (NULL for any group)
+ * @return bool false if there are no such tasks in the pool
+ */
+static bool find_task(TaskPool* pool, Task* task, const TaskGroup* group) {
+    if (pool->queued.load() == 0) return false;
+
+    int own_id = own_queue(pool);
+    if (take_task(&pool->queues[own_id], task, false, group)) return true;
+
+    for (int shift = 1; shift < pool->thread_count; shift++) {
+        int victim_id = (own_id + shift) % pool->thread_count;
+        if (take_task(&pool->queues[victim_id], task, true, group)) return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Execute the task and mark it as finished.
+ */
+static void run_task(TaskPool* pool, const Task& task) {
+    pool->queued--;
+    task.function(task.argument);
+    task.group->pending--;
+}
+
+/**
+ * @brief Main loop of the worker thread.
+ */
+static void* worker_loop(void* void_argument) {
+    WorkerArgument* argument = (WorkerArgument*)void_argument;
+    TaskPool* pool = argument->pool;
+    worker_pool = pool;
+    worker_id = argument->id;
+    free(argument);
+
+    while (true) {
+        Task task = {};
+        if (find_task(pool, &task, NULL)) {
+            run_task(pool, task);
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->stop && pool->queued.load() == 0) pthread_cond_wait(&pool->wakeup, &pool->lock);
+        bool stop = pool->stop;
+        pthread_mutex_unlock(&pool->lock);
+
+        if (stop) return NULL;
+    }
+}
+
+void taskpool_init(TaskPool* pool, int thread_count, int* error_code) {
+    _LOG_FAIL_CHECK_(pool, "error", ERROR_REPORTS, return;, error_code, EFAULT);
+    if (thread_count < 1) thread_count = 1;
+
+    pool->thread_count = thread_count;
+    pool->stop = false;
+    pool->queued = 0;
+    pool->queues = new TaskQueue[thread_count];
+    pool->threads = (pthread_t*)calloc(thread_count, sizeof(*pool->threads));
+    _LOG_FAIL_CHECK_(pool->threads, "error", ERROR_REPORTS,
+                     delete[] pool->queues;pool->queues = NULL;return;, error_code, ENOMEM);
+
+    for (int thread_id = 1; thread_id < thread_count; thread_id++) {
+        WorkerArgument* argument = (WorkerArgument*)calloc(1, sizeof(*argument));
+        argument->pool = pool;
+        argument->id = thread_id;
+        if (pthread_create(&pool->threads[thread_id], NULL, worker_loop, argument)) {
+            free(argument);
+            //* Pool works with fewer threads, tasks are never bound to a particular one.
+            log_printf(WARNINGS, "warning", "Failed to start worker %d of %d.\n", thread_id, thread_count);
+            pool->thread_count = thread_id;
+            break;
+        }
+    }
+}
+
+void taskpool_destroy(TaskPool* pool) {
+    if (!pool || !pool->queues) return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->wakeup);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int thread_id = 1; thread_id < pool->thread_count; thread_id++) {
+        pthread_join(pool->threads[thread_id], NULL);
+    }
+
+    free(pool->threads);
+    delete[] pool->queues;
+    pool->threads = NULL;
+    pool->queues = NULL;
+    pool->thread_count = 0;
+}
+
+void taskpool_spawn(TaskPool* pool, TaskGroup* group, task_function_t function, void* argument) {
+    group->pending++;
+    Task task = {function, argument, group};
+
+    pool->queued++;
+    if (pool->thread_count <= 1 || !push_task(&pool->queues[own_queue(pool)], task)) {
+        run_task(pool, task);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_signal(&pool->wakeup);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void taskpool_wait(TaskPool* pool, TaskGroup* group) {
+    //* Tasks of other groups are left to the workers: running them here would delay this group
+    //* by all of their work and let them change errno of the waiting task.
+    while (group->pending.load() > 0) {
+        Task task = {};
+        if (find_task(pool, &task, group)) run_task(pool, task);
+        else sched_yield();
+    }
+}
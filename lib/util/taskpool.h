@@ -0,0 +1,122 @@
+/**
+ * @file taskpool.h
+ * @author Ilya Kudryashov (kudriashov.it@phystech.edu)
+ * @brief Work-stealing pool of threads for fork-join parallelism.
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef TASKPOOL_H
+#define TASKPOOL_H
+
+#include <pthread.h>
+#include <atomic>
+
+typedef void (*task_function_t)(void* argument);
+
+/**
+ * @brief Set of tasks that can be waited for together.
+ *
+ * @param pending number of spawned tasks that have not finished yet
+ */
+struct TaskGroup {
+    std::atomic<int> pending = {0};
+};
+
+/**
+ * @brief Task waiting for execution.
+ *
+ * @param function function to call
+ * @param argument its argument
+ * @param group group the task belongs to
+ */
+struct Task {
+    task_function_t function = NULL;
+    void* argument = NULL;
+    TaskGroup* group = NULL;
+};
+
+static const int TASK_QUEUE_CAPACITY = 4096;
+
+/**
+ * @brief Double-ended queue of tasks of a single worker.
+ *
+ * Owner pushes and pops tasks from the bottom, other workers steal the oldest ones from the top.
+ *
+ * @param tasks ring buffer of tasks
+ * @param top index of the oldest task
+ * @param bottom index after the newest task
+ * @param lock mutex guarding the queue
+ */
+struct TaskQueue {
+    Task tasks[TASK_QUEUE_CAPACITY];
+    long top = 0;
+    long bottom = 0;
+    pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+};
+
+/**
+ * @brief Pool of worker threads.
+ *
+ * Thread that calls taskpool_wait() is considered worker 0 and helps executing tasks,
+ * so pool of N threads starts N - 1 additional ones.
+ *
+ * @param thread_count number of workers
+ * @param threads started threads
+ * @param queues task queues, one per worker
+ * @param queued number of tasks in all queues
+ * @param stop set when workers have to exit
+ * @param lock mutex for the idle workers
+ * @param wakeup condition idle workers wait on
+ */
+struct TaskPool {
+    int thread_count = 0;
+    pthread_t* threads = NULL;
+    TaskQueue* queues = NULL;
+    std::atomic<long> queued = {0};
+    bool stop = false;
+    pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t wakeup = PTHREAD_COND_INITIALIZER;
+};
+
+/**
+ * @brief Start worker threads of the pool.
+ *
+ * @param pool pool to initialize
+ * @param thread_count number of workers including the calling thread
+ * @param error_code where to put error codes
+ */
+void taskpool_init(TaskPool* pool, int thread_count, int* error_code = NULL);
+
+/**
+ * @brief Stop worker threads and free the pool.
+ *
+ * @param pool pool to destroy
+ */
+void taskpool_destroy(TaskPool* pool);
+
+/**
+ * @brief Schedule task for execution (executes it right away if the queue is full).
+ *
+ * @param pool pool to execute the task
+ * @param group group to add the task to
+ * @param function function to call
+ * @param argument its argument
+ */
+void taskpool_spawn(TaskPool* pool, TaskGroup* group, task_function_t function, void* argument);
+
+/**
+ * @brief Execute tasks of the group until all of them are finished.
+ *
+ * Tasks of other groups are never executed by the waiting thread, so a task may wait
+ * for its subtasks without running unrelated work nested inside it.
+ *
+ * @param pool pool the tasks were spawned in
+ * @param group group to wait for
+ */
+void taskpool_wait(TaskPool* pool, TaskGroup* group);
+
+#endif
@@ -12,12 +12,21 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
 #include <clocale>
+#include <atomic>
 
 #include "lib/util/dbg/debug.h"
+#include "lib/util/dbg/profiler.h"
 #include "lib/util/argparser.h"
 #include "lib/txtproc.h"
 #include "lib/sorting.h"
+#include "lib/util/taskpool.h"
+#include "lib/extsort.h"
+#include "lib/dedup.h"
+#include "lib/rhymeindex.h"
+#include "lib/queryserver.h"
 
 /**
  * @brief Print a bunch of owls.
@@ -34,30 +43,294 @@ void print_owl(const int argc, void** argv, const char* argument);
  */
 void print_label();
 
+/**
+ * @brief Sorted order of the lines of the text.
+ * 
+ * @param lines copies of the lines of the text in the order of the view
+ * @param keys buffer with sorting keys of the lines
+ * @param length number of lines in the view
+ * @param lines_size size of the lines buffer in bytes
+ * @param keys_size size of the keys buffer in bytes
+ */
+struct TextView {
+    Charline* lines = NULL;
+    wchar_t* keys = NULL;
+    int length = 0;
+    size_t lines_size = 0;
+    size_t keys_size = 0;
+};
+
 /**
  * @brief Stores text as a bunch of lines.
  * 
- * @param lines pointers to characters stored in charbuffer making lines of text
+ * @param lines pointers to characters stored in charbuffer making lines of text (never reordered)
  * @param charbuffer buffer with concatenated together lines of text
+ * @param source mapped source file (only kept in zero-copy mode)
+ * @param sorted lines sorted by their beginnings
+ * @param rhymed lines sorted by their endings
+ * @param arena arena lines, charbuffer, views and sort scratch of the text are allocated from
+ * @param uniques first line of every group of identical lines (NULL unless lines are deduplicated)
+ * @param groups groups of identical lines
  */
 struct Text {
     Charline* lines = NULL;
     wchar_t* charbuffer = NULL;
+    Source source = {};
+    TextView sorted = {};
+    TextView rhymed = {};
+    Arena arena = {};
+    Charline* uniques = NULL;
+    LineGroups groups = {};
+};
+
+enum OUTPUT_FILES {
+    SORTED_OUTPUT,
+    RHYMED_OUTPUT,
+    COPY_OUTPUT,
+    NUMBER_OF_OUTPUTS,
+};
+
+/**
+ * @brief Task of the sorting pipeline: one ordering of the lines or the direct copy of the text.
+ * 
+ * Exactly one of text and lines is set: the former for the wide pipeline, the latter for the UTF-8 one.
+ * Task sorts its view on a pool thread, then spawns the export of the view into its group,
+ * so the other ordering is sorted while this one is written.
+ * 
+ * @param text decoded text (wide pipeline only)
+ * @param source mapped source file
+ * @param arena arena buffers of the UTF-8 pipeline are allocated from
+ * @param lines lines of the UTF-8 pipeline in the original order
+ * @param uniques first line of every group of identical UTF-8 lines (NULL unless lines are deduplicated)
+ * @param groups groups of identical UTF-8 lines
+ * @param view lines of the UTF-8 pipeline in the order of the task
+ * @param view_length number of lines in the view to write (less than text_size with -K or -Dcount)
+ * @param view_size number of bytes the view took from the arena (see release_ordering())
+ * @param keys sorting keys of the view (NULL once they are released)
+ * @param keys_size number of bytes the keys took from the arena (see release_ordering())
+ * @param text_size number of lines in the text
+ * @param output output of the task (see OUTPUT_FILES)
+ * @param output_name name of the file to write
+ * @param group group run_pipeline() waits for: both sorts, both exports and the copy
+ * @param error_code error slot of the pipeline shared by its tasks: first errno one of them failed with
+ *                   (0 while all succeed), read by run_pipeline() after the group ends
+ */
+struct PipelineTask {
+    Text* text = NULL;
+    Source* source = NULL;
+    Arena* arena = NULL;
+    U8line* lines = NULL;
+    U8line* uniques = NULL;
+    const LineGroups* groups = NULL;
+    U8line* view = NULL;
+    int view_length = 0;
+    size_t view_size = 0;
+    char* keys = NULL;
+    size_t keys_size = 0;
+    int text_size = 0;
+    int output = SORTED_OUTPUT;
+    const char* output_name = NULL;
+    TaskGroup* group = NULL;
+    std::atomic<int>* error_code = NULL;
+};
+
+/**
+ * @brief Files to sort in batch mode and progress of the workers sorting them.
+ * 
+ * @param file_names names of the files
+ * @param file_count number of the files
+ * @param next_file index of the first file no worker has taken yet
+ * @param failed_count number of files that could not be sorted
+ */
+struct Batch {
+    char** file_names = NULL;
+    int file_count = 0;
+    std::atomic<int> next_file = {0};
+    std::atomic<int> failed_count = {0};
+};
+
+/**
+ * @brief What is done with identical lines before sorting.
+ */
+enum DEDUP_MODES {
+    NO_DEDUP,
+    DEDUP_EXPAND,
+    DEDUP_COUNT,
+};
+
+static const char* const DEFAULT_OUTPUT_NAMES[NUMBER_OF_OUTPUTS] = {
+    "text_sorted.txt", "text_inv_sorted.txt", "text_copy.txt"
+};
+
+//* Batch outputs are put next to their sources, with these suffixes appended to the source names.
+static const char* const BATCH_OUTPUT_SUFFIXES[NUMBER_OF_OUTPUTS] = {
+    ".sorted.txt", ".inv_sorted.txt", ".copy.txt"
 };
 
 /**
- * @brief Free internal buffers of the Text struct.
+ * @brief Free internal buffers of the Text struct, its arena keeps the memory for the next text.
  * 
  * @param text text to free
  */
 void free_text(Text* text, int* err_code = NULL);
 
+/**
+ * @brief Write lines of the text to the file using output method selected by command line tags.
+ * 
+ * @param file_name name of the file to write lines into
+ * @param text text the lines belong to
+ * @param lines lines to write
+ * @param length number of lines
+ */
+void export_lines(const char* file_name, const Text* text, const Charline* lines, int length);
+
+/**
+ * @brief Sort lines by their keys with the engine selected by command line tags.
+ * 
+ * @param lines lines with built keys
+ * @param length number of lines
+ * @param arena arena to take sort scratch from (NULL to use the heap)
+ */
+void sort_lines(Charline* lines, int length, Arena* arena);
+
+/**
+ * @brief Sort UTF-8 lines by their keys with the engine selected by command line tags.
+ * 
+ * @param lines lines with built keys
+ * @param length number of lines
+ * @param arena arena to take sort scratch from (NULL to use the heap)
+ */
+void sort_lines(U8line* lines, int length, Arena* arena);
+
+/**
+ * @brief Sort the lines or only put the first -K of them in order if the tag is set.
+ * 
+ * @param lines lines with built keys
+ * @param length number of lines
+ * @param arena arena to take sort scratch from (NULL to use the heap)
+ * @return int number of sorted lines at the beginning of the array
+ */
+int sort_top_lines(Charline* lines, int length, Arena* arena);
+
+/**
+ * @brief Sort the UTF-8 lines or only put the first -K of them in order if the tag is set.
+ * 
+ * @param lines lines with built keys
+ * @param length number of lines
+ * @param arena arena to take sort scratch from (NULL to use the heap)
+ * @return int number of sorted lines at the beginning of the array
+ */
+int sort_top_lines(U8line* lines, int length, Arena* arena);
+
+/**
+ * @brief Sort and export the text keeping its lines as UTF-8 bytes of the mapped source file.
+ * 
+ * @param source mapped source file
+ * @param output_names names of the sorted, inv-sorted and copied outputs (see OUTPUT_FILES)
+ * @param arena arena to allocate buffers from, the caller resets it once the file is written
+ * @param error_code where to put error codes
+ * @return int EXIT_SUCCESS or EXIT_FAILURE
+ */
+int sort_utf8_text(Source* source, const char* const* output_names, Arena* arena, int* error_code = NULL);
+
+/**
+ * @brief Sort and export both orderings of the lines and write the direct copy of the text.
+ * 
+ * Orderings are sorted at the same time when the thread pool has several threads,
+ * each of them is exported as soon as it is sorted, while the other one may still be sorting.
+ * 
+ * @param task template of the pipeline tasks with the text or the UTF-8 lines set
+ * @param output_names names of the sorted, inv-sorted and copied outputs (see OUTPUT_FILES)
+ * @param error_code where to put error codes
+ */
+void run_pipeline(const PipelineTask* task, const char* const* output_names, int* error_code = NULL);
+
+/**
+ * @brief Sort every file of the batch on the thread pool.
+ * 
+ * @param batch_name file with one file name per line or directory with the files to sort
+ * @return int EXIT_SUCCESS if all files were sorted, EXIT_FAILURE otherwise
+ */
+int sort_batch(const char* batch_name);
+
+/**
+ * @brief Sort lines of the source file by their endings and save them as the rhyme index.
+ * 
+ * @param index_name name of the index file
+ * @return int EXIT_SUCCESS or EXIT_FAILURE
+ */
+int build_rhyme_index(const char* index_name);
+
+/**
+ * @brief Print lines of the rhyme index ending with the suffix (at most -K of them if it is set).
+ * 
+ * @param index_name name of the index file
+ * @param suffix UTF-8 ending to look for
+ * @return int EXIT_SUCCESS or EXIT_FAILURE
+ */
+int print_rhymes(const char* index_name, const char* suffix);
+
+/**
+ * @brief Load the source file once, sort its lines both ways and answer queries on the socket until stopped.
+ * 
+ * @param socket_name path of the Unix domain socket
+ * @return int EXIT_SUCCESS or EXIT_FAILURE
+ */
+int serve_corpus(const char* socket_name);
+
+/**
+ * @brief Build sorted view of the text lines.
+ * 
+ * @param text text to sort
+ * @param text_size number of lines in the text
+ * @param view view to fill
+ * @param reverse sort lines by their endings
+ */
+void build_view(Text* text, int text_size, TextView* view, bool reverse);
+
+/**
+ * @brief Build sorted view of the UTF-8 lines of the pipeline task.
+ * 
+ * @param task task to build the view of
+ * @param reverse sort lines by their endings
+ */
+void build_view(PipelineTask* task, bool reverse);
+
 static int log_threshold = 1;
 
 static const size_t MAX_SOURCE_NAME_LENGTH = 1024;
 static char text_source_name[MAX_SOURCE_NAME_LENGTH] = "onegin.txt";
+static char batch_source_name[MAX_SOURCE_NAME_LENGTH] = "";
+
+static bool zero_copy = false;
+static bool utf8_mode = false;
+static bool async_log = false;
+
+static const size_t MAX_ENGINE_NAME_LENGTH = 1024;
+static char sort_engine[MAX_ENGINE_NAME_LENGTH] = "mkqsort";
+
+static int thread_count = 1;
+static TaskPool thread_pool;
+
+static int memory_budget = 0;
+
+static const size_t MAX_FORMAT_NAME_LENGTH = 1024;
+static char profile_format[MAX_FORMAT_NAME_LENGTH] = "";
 
-static const int NUMBER_OF_TAGS = 3;
+static const size_t MAX_DEDUP_NAME_LENGTH = 1024;
+static char dedup_name[MAX_DEDUP_NAME_LENGTH] = "";
+static int dedup_mode = NO_DEDUP;
+
+static int top_count = 0;
+
+static char rhyme_index_name[MAX_SOURCE_NAME_LENGTH] = "";
+
+static const size_t MAX_SUFFIX_LENGTH = 1024;
+static char rhyme_suffix[MAX_SUFFIX_LENGTH] = "";
+
+static char socket_name[MAX_SOURCE_NAME_LENGTH] = "";
+
+static const int NUMBER_OF_TAGS = 16;
 static const struct ActionTag LINE_TAGS[NUMBER_OF_TAGS] = {
     {
         .name = {'O', "owl"}, 
@@ -78,6 +351,16 @@ static const struct ActionTag LINE_TAGS[NUMBER_OF_TAGS] = {
         .description = "sets log threshold to the specified number.\n"
                         "   Does not check if integer was specified."
     },
+    {
+        .name = {'A', "async-log"}, 
+        .action = {
+            .parameters = (void*[]) {&async_log},
+            .parameters_length = 1, 
+            .function = edit_flag,
+        },
+        .description = "writes log messages from a background thread instead of\n"
+                        "    the logging one (messages are only lost if the program crashes)."
+    },
     {
         .name = {'R', ""}, 
         .action = {
@@ -88,6 +371,126 @@ static const struct ActionTag LINE_TAGS[NUMBER_OF_TAGS] = {
         .description = "makes the program open\n"
                         "    specified file instead of the default one."
     },
+    {
+        .name = {'B', ""}, 
+        .action = {
+            .parameters = (void*[]) {&batch_source_name},
+            .parameters_length = 1, 
+            .function = edit_string,
+        },
+        .description = "sorts every file listed in the specified file (one name per line)\n"
+                        "    or lying in the specified directory as UTF-8 bytes on -T threads,\n"
+                        "    writing <file>.sorted.txt, <file>.inv_sorted.txt and <file>.copy.txt."
+    },
+    {
+        .name = {'Z', "zero-copy"}, 
+        .action = {
+            .parameters = (void*[]) {&zero_copy},
+            .parameters_length = 1, 
+            .function = edit_flag,
+        },
+        .description = "writes original bytes of the lines straight from the mapped\n"
+                        "    source file instead of encoding them again."
+    },
+    {
+        .name = {'U', "utf8"}, 
+        .action = {
+            .parameters = (void*[]) {&utf8_mode},
+            .parameters_length = 1, 
+            .function = edit_flag,
+        },
+        .description = "sorts lines as UTF-8 bytes of the mapped source file without decoding\n"
+                        "    them into wide characters (same order, quarter of the memory)."
+    },
+    {
+        .name = {'E', ""}, 
+        .action = {
+            .parameters = (void*[]) {&sort_engine},
+            .parameters_length = 1, 
+            .function = edit_string,
+        },
+        .description = "selects sorting engine: qsort, msort or mkqsort (default)."
+    },
+    {
+        .name = {'T', ""}, 
+        .action = {
+            .parameters = (void*[]) {&thread_count},
+            .parameters_length = 1, 
+            .function = edit_int,
+        },
+        .description = "sets the number of threads msort engine and batch mode run on (1 by default)."
+    },
+    {
+        .name = {'M', ""}, 
+        .action = {
+            .parameters = (void*[]) {&memory_budget},
+            .parameters_length = 1, 
+            .function = edit_int,
+        },
+        .description = "sorts the file in external memory using about the specified\n"
+                        "    number of megabytes (lines are written as they are in the source)."
+    },
+    {
+        .name = {'P', ""}, 
+        .action = {
+            .parameters = (void*[]) {&profile_format},
+            .parameters_length = 1, 
+            .function = edit_string,
+        },
+        .description = "logs phase durations, comparison counts, bytes read and written\n"
+                        "    and peak memory usage as text or json."
+    },
+    {
+        .name = {'D', ""}, 
+        .action = {
+            .parameters = (void*[]) {&dedup_name},
+            .parameters_length = 1, 
+            .function = edit_string,
+        },
+        .description = "sorts only distinct lines: expand writes every copy as usual,\n"
+                        "    count writes every distinct line once preceded by its count."
+    },
+    {
+        .name = {'K', ""}, 
+        .action = {
+            .parameters = (void*[]) {&top_count},
+            .parameters_length = 1, 
+            .function = edit_int,
+        },
+        .description = "writes only the first specified number of lines of both orderings,\n"
+                        "    selecting them with a bounded heap instead of sorting all lines."
+    },
+    {
+        .name = {'X', ""}, 
+        .action = {
+            .parameters = (void*[]) {&rhyme_index_name},
+            .parameters_length = 1, 
+            .function = edit_string,
+        },
+        .description = "saves lines of the file sorted by their endings as the specified\n"
+                        "    rhyme index instead of writing the outputs (see -L)."
+    },
+    {
+        .name = {'L', ""}, 
+        .action = {
+            .parameters = (void*[]) {&rhyme_suffix},
+            .parameters_length = 1, 
+            .function = edit_string,
+        },
+        .description = "prints lines of the rhyme index set by -X ending with the specified suffix\n"
+                        "    (punctuation is ignored as in the inv-sorted output)."
+    },
+    {
+        .name = {'S', ""}, 
+        .action = {
+            .parameters = (void*[]) {&socket_name},
+            .parameters_length = 1, 
+            .function = edit_string,
+        },
+        .description = "keeps both orderings of the file in memory and answers PREFIX, SUFFIX\n"
+                        "    and RANGE queries on the specified Unix socket until interrupted\n"
+                        "    with -T worker threads (answers are limited to -K lines)."
+    },
 };
 
 int main(const int argc, const char** argv) {
@@ -95,46 +498,129 @@ int main(const int argc, const char** argv) {
 
     setlocale(LC_ALL,"C.UTF-8");
     setlocale(LC_CTYPE,"C.UTF-8");
+    //* setlocale() may leave errno set even when it succeeds.
+    errno = 0;
 
     parse_args(argc, argv, NUMBER_OF_TAGS, LINE_TAGS);
     log_init("program_log.log", log_threshold, &errno);
+    if (async_log) log_start_async(&errno);
     print_label();
 
-    log_printf(STATUS_REPORTS, "status", "Reading file %s...\n", text_source_name);
+    if (*profile_format) profiler_enable();
+    int report_format = strcmp(profile_format, "json") == 0 ? PROFILE_JSON : PROFILE_TEXT;
 
-    struct Text text;
-    int text_size = read_file(text_source_name, &text.lines, &text.charbuffer, &errno);
-    _ABORT_ON_ERRNO_();
+    if (*dedup_name) {
+        dedup_mode = strcmp(dedup_name, "count") == 0 ? DEDUP_COUNT : DEDUP_EXPAND;
+        if (strcmp(dedup_name, "count") != 0 && strcmp(dedup_name, "expand") != 0)
+            log_printf(WARNINGS, "warning", "Unknown dedup mode %s, using expand.\n", dedup_name);
+    }
 
-    if (text_size == READING_FAILURE) {
-        log_printf(ERROR_REPORTS, "error", "Failed to read file %s. Terminating.\n", text_source_name, &text);
-        return EXIT_FAILURE;
+    if (thread_count > 1) {
+        taskpool_init(&thread_pool, thread_count, &errno);
+        _ABORT_ON_ERRNO_();
     }
 
-    log_printf(STATUS_REPORTS, "status", "Descovered %d lines of text.\n", text_size);
+    if (*rhyme_index_name) {
+        int exit_code = *rhyme_suffix ? print_rhymes(rhyme_index_name, rhyme_suffix)
+                                      : build_rhyme_index(rhyme_index_name);
+        taskpool_destroy(&thread_pool);
+        profiler_report(report_format);
+        return exit_code;
+    }
 
-    log_printf(STATUS_REPORTS, "status", "Sorting...\n");
-    qsort(text.lines, text_size, sizeof(*text.lines), compare_lines);
+    if (*socket_name) {
+        int exit_code = serve_corpus(socket_name);
+        taskpool_destroy(&thread_pool);
+        profiler_report(report_format);
+        return exit_code;
+    }
 
-    log_printf(STATUS_REPORTS, "status", "Exporting sorted lines...\n");
-    write_file("text_sorted.txt", text.lines, text_size, &errno);
+    if (*batch_source_name) {
+        log_printf(STATUS_REPORTS, "status", "Sorting batch %s...\n", batch_source_name);
+        int exit_code = sort_batch(batch_source_name);
+        taskpool_destroy(&thread_pool);
+        profiler_report(report_format);
+        return exit_code;
+    }
+
+    if (memory_budget > 0) {
+        log_printf(STATUS_REPORTS, "status", "Sorting file %s in external memory...\n", text_source_name);
+        {
+            _PROFILE_PHASE_("external_sort");
+            external_sort(text_source_name, DEFAULT_OUTPUT_NAMES[SORTED_OUTPUT], DEFAULT_OUTPUT_NAMES[RHYMED_OUTPUT],
+                          (size_t)memory_budget << 20, &errno);
+        }
+        _ABORT_ON_ERRNO_();
+
+        log_printf(STATUS_REPORTS, "status", "Writing the direct copy...\n");
+        {
+            _PROFILE_PHASE_("copy");
+            Source source = {};
+            map_file(text_source_name, &source, &errno);
+            if (!errno) copy_source(DEFAULT_OUTPUT_NAMES[COPY_OUTPUT], &source, &errno);
+            unmap_file(&source);
+        }
+        _ABORT_ON_ERRNO_();
+
+        taskpool_destroy(&thread_pool);
+        profiler_report(report_format);
+        return EXIT_SUCCESS;
+    }
+
+    log_printf(STATUS_REPORTS, "status", "Reading file %s...\n", text_source_name);
+
+    struct Text text;
+    {
+        _PROFILE_PHASE_("read");
+        map_file(text_source_name, &text.source, &errno);
+    }
     _ABORT_ON_ERRNO_();
 
-    log_printf(STATUS_REPORTS, "status", "Re-sorting...\n");
-    msort(text.lines, text_size, sizeof(*text.lines), compare_reverse_lines);
+    if (utf8_mode || text.source.ascii) {
+        //* Decoded ASCII is the same bytes, so sorting them directly gives exactly the same output.
+        if (text.source.ascii) log_printf(STATUS_REPORTS, "status", "File is pure ASCII, sorting its bytes.\n");
+        int exit_code = sort_utf8_text(&text.source, DEFAULT_OUTPUT_NAMES, &text.arena, &errno);
+        unmap_file(&text.source);
+        arena_destroy(&text.arena);
+        taskpool_destroy(&thread_pool);
+        profiler_report(report_format);
+        return exit_code;
+    }
 
-    log_printf(STATUS_REPORTS, "status", "Exporting inv-sorted lines...\n");
-    write_file("text_inv_sorted.txt", text.lines, text_size, &errno);
+    int text_size = READING_FAILURE;
+    {
+        _PROFILE_PHASE_("read");
+        text_size = parse_source(&text.source, &text.lines, &text.charbuffer, &text.arena, &errno);
+        //* Only zero-copy output needs the mapping once the lines are decoded.
+        if (!zero_copy) unmap_file(&text.source);
+    }
     _ABORT_ON_ERRNO_();
 
-    log_printf(STATUS_REPORTS, "status", "Rebuilding source text...\n");
-    msort(text.lines, text_size, sizeof(*text.lines), compare_line_pointers);
+    if (dedup_mode != NO_DEDUP && text_size != READING_FAILURE) {
+        _PROFILE_PHASE_("dedup");
+        group_lines(text.lines, text_size, &text.uniques, &text.groups, &text.arena, &errno);
+        log_printf(STATUS_REPORTS, "status", "Found %d distinct lines.\n", text.groups.unique_count);
+    }
+    _ABORT_ON_ERRNO_();
 
-    log_printf(STATUS_REPORTS, "status", "Writing the direct copy...\n");
-    write_file("text_copy.txt", text.lines, text_size, &errno);
+    if (text_size == READING_FAILURE) {
+        log_printf(ERROR_REPORTS, "error", "Failed to read file %s. Terminating.\n", text_source_name, &text);
+        return EXIT_FAILURE;
+    }
+
+    log_printf(STATUS_REPORTS, "status", "Descovered %d lines of text.\n", text_size);
+
+    PipelineTask task = {};
+    task.text = &text;
+    task.source = &text.source;
+    task.text_size = text_size;
+    run_pipeline(&task, DEFAULT_OUTPUT_NAMES, &errno);
     _ABORT_ON_ERRNO_();
 
     free_text(&text);
+    arena_destroy(&text.arena);
+    taskpool_destroy(&thread_pool);
+    profiler_report(report_format);
 
     return EXIT_SUCCESS;
 }
@@ -164,6 +650,656 @@ void free_text(Text* text, int* err_code) {
     _LOG_FAIL_CHECK_(text->charbuffer, "error", ERROR_REPORTS, return, err_code, EFAULT);
     _LOG_FAIL_CHECK_(text->lines, "error", ERROR_REPORTS, return, err_code, EFAULT);
 
-    free(text->charbuffer); text->charbuffer = NULL;
-    free(text->lines);      text->lines      = NULL;
+    unmap_file(&text->source);
+
+    //* Everything the text owns is in its arena, a single reset frees it all.
+    arena_reset(&text->arena);
+    text->charbuffer = NULL;
+    text->lines = NULL;
+    text->sorted = {};
+    text->rhymed = {};
+    text->uniques = NULL;
+    text->groups = {};
+}
+
+void export_lines(const char* file_name, const Text* text, const Charline* lines, int length) {
+    if (zero_copy) {
+        write_source_lines(file_name, &text->source, lines, length, &errno);
+    } else {
+        write_file(file_name, lines, length, &errno);
+    }
+}
+
+void sort_lines(Charline* lines, int length, Arena* arena) {
+    if (strcmp(sort_engine, "qsort") == 0) {
+        qsort(lines, length, sizeof(*lines), compare_keys);
+    } else if (strcmp(sort_engine, "msort") == 0) {
+        parallel_msort(lines, length, CompareKeys(), &thread_pool, arena, &errno);
+    } else {
+        if (strcmp(sort_engine, "mkqsort") != 0)
+            log_printf(WARNINGS, "warning", "Unknown sorting engine %s, using mkqsort.\n", sort_engine);
+        mkqsort(lines, length, sizeof(*lines), get_line_key, arena, &errno);
+    }
+}
+
+void sort_lines(U8line* lines, int length, Arena* arena) {
+    if (strcmp(sort_engine, "qsort") == 0) {
+        qsort(lines, length, sizeof(*lines), compare_u8keys);
+    } else if (strcmp(sort_engine, "msort") == 0) {
+        parallel_msort(lines, length, CompareU8Keys(), &thread_pool, arena, &errno);
+    } else {
+        if (strcmp(sort_engine, "mkqsort") != 0)
+            log_printf(WARNINGS, "warning", "Unknown sorting engine %s, using mkqsort.\n", sort_engine);
+        mkqsort(lines, length, sizeof(*lines), get_u8line_key, arena, &errno);
+    }
+}
+
+int sort_utf8_text(Source* source, const char* const* output_names, Arena* arena, int* error_code) {
+    //* Status is kept apart from errno, which other work on the same thread may change.
+    int status = 0;
+
+    U8line* lines = NULL;
+    int text_size = READING_FAILURE;
+    {
+        _PROFILE_PHASE_("read");
+        text_size = parse_source(source, &lines, arena, &status);
+    }
+
+    if (text_size == READING_FAILURE) {
+        log_printf(ERROR_REPORTS, "error", "Failed to split the source of %s into lines.\n", output_names[COPY_OUTPUT]);
+        if (error_code) *error_code = status;
+        return EXIT_FAILURE;
+    }
+
+    log_printf(STATUS_REPORTS, "status", "Descovered %d lines of text.\n", text_size);
+
+    U8line* uniques = NULL;
+    LineGroups groups = {};
+    if (dedup_mode != NO_DEDUP) {
+        _PROFILE_PHASE_("dedup");
+        if (group_lines(lines, text_size, &uniques, &groups, arena, &status) == READING_FAILURE) {
+            if (error_code) *error_code = status;
+            return EXIT_FAILURE;
+        }
+        log_printf(STATUS_REPORTS, "status", "Found %d distinct lines.\n", groups.unique_count);
+    }
+
+    PipelineTask task = {};
+    task.source = source;
+    task.arena = arena;
+    task.lines = lines;
+    task.uniques = uniques;
+    task.groups = &groups;
+    task.text_size = text_size;
+    run_pipeline(&task, output_names, &status);
+
+    if (status && error_code) *error_code = status;
+    return status ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/**
+ * @brief Common part of sort_top_lines() overloads.
+ */
+template <typename Line, typename Compare>
+static int _sort_top_lines(Line* lines, int length, Arena* arena, Compare comparison) {
+    if (top_count <= 0 || top_count >= length) {
+        sort_lines(lines, length, arena);
+        return length;
+    }
+
+    //* Ties are broken by positions, so the heap selects the same lines a stable sort puts first.
+    partial_sort(lines, length, top_count, comparison);
+    return top_count;
+}
+
+int sort_top_lines(Charline* lines, int length, Arena* arena) {
+    return _sort_top_lines(lines, length, arena, CompareStable<CompareKeys>());
+}
+
+int sort_top_lines(U8line* lines, int length, Arena* arena) {
+    return _sort_top_lines(lines, length, arena, CompareStable<CompareU8Keys>());
+}
+
+/**
+ * @brief Write distinct lines preceded by the number of their copies.
+ * 
+ * @param file_name name of the file to write lines into
+ * @param lines distinct lines
+ * @param length number of lines
+ * @param groups groups of identical lines the distinct lines represent
+ */
+template <typename Line>
+static void export_counted_lines(const char* file_name, const Line* lines, int length, const LineGroups* groups) {
+    int* counts = (int*)malloc(length * sizeof(*counts) + 1);
+    _LOG_FAIL_CHECK_(counts, "error", ERROR_REPORTS, return;, &errno, ENOMEM);
+
+    for (int line_id = 0; line_id < length; line_id++) counts[line_id] = get_group_size(groups, lines[line_id].index);
+    write_counted_file(file_name, lines, counts, length, &errno);
+
+    free(counts);
+}
+
+/**
+ * @brief Record failure of the pipeline task in the error slot of its pipeline unless one is already there.
+ *
+ * @return int error of the task (0 on success)
+ */
+static int report_task_error(PipelineTask* task, int task_error) {
+    int no_error = 0;
+    if (task_error) task->error_code->compare_exchange_strong(no_error, task_error);
+    return task_error;
+}
+
+static const char* const SORT_PHASE_NAMES[] = {"sort", "resort"};
+static const char* const EXPORT_PHASE_NAMES[] = {"export_sorted", "export_rhymed"};
+
+/**
+ * @brief Give the view of the exported ordering back to the arena, so the next ordering reuses its memory.
+ */
+static void release_ordering(PipelineTask* task) {
+    //* Orderings sorted at the same time allocate in any order, their memory is only freed by the reset.
+    if (thread_pool.thread_count > 1) return;
+
+    if (task->text) {
+        TextView* view = task->output == RHYMED_OUTPUT ? &task->text->rhymed : &task->text->sorted;
+        arena_release(&task->text->arena, view->keys, view->keys_size);
+        arena_release(&task->text->arena, view->lines, view->lines_size);
+        *view = {};
+    } else {
+        arena_release(task->arena, task->keys, task->keys_size);
+        arena_release(task->arena, task->view, task->view_size);
+        task->keys = NULL;
+        task->view = NULL;
+    }
+}
+
+/**
+ * @brief Pipeline task exporting the sorted ordering.
+ */
+static void export_ordering(void* void_task) {
+    PipelineTask* task = (PipelineTask*)void_task;
+    //* Tasks may run inside each other while a sort waits for its pieces, errno of the outer one is kept.
+    int outer_errno = errno;
+    errno = 0;
+
+    log_printf(STATUS_REPORTS, "status", "Exporting %s...\n", task->output_name);
+    {
+        _PROFILE_PHASE_(EXPORT_PHASE_NAMES[task->output]);
+        if (task->text) {
+            const TextView* view = task->output == RHYMED_OUTPUT ? &task->text->rhymed : &task->text->sorted;
+            if (dedup_mode == DEDUP_COUNT) {
+                export_counted_lines(task->output_name, view->lines, view->length, &task->text->groups);
+            } else {
+                export_lines(task->output_name, task->text, view->lines, view->length);
+            }
+        } else if (dedup_mode == DEDUP_COUNT) {
+            export_counted_lines(task->output_name, task->view, task->view_length, task->groups);
+        } else {
+            write_file(task->output_name, task->view, task->view_length, &errno);
+        }
+    }
+    release_ordering(task);
+
+    report_task_error(task, errno);
+    errno = outer_errno;
+}
+
+/**
+ * @brief Pipeline task sorting the ordering and spawning its export.
+ */
+static void sort_ordering(void* void_task) {
+    PipelineTask* task = (PipelineTask*)void_task;
+    int outer_errno = errno;
+    errno = 0;
+
+    bool reverse = task->output == RHYMED_OUTPUT;
+    log_printf(STATUS_REPORTS, "status", "Sorting %s...\n", task->output_name);
+    {
+        _PROFILE_PHASE_(SORT_PHASE_NAMES[reverse]);
+        if (task->text) {
+            build_view(task->text, task->text_size, reverse ? &task->text->rhymed : &task->text->sorted, reverse);
+        } else {
+            build_view(task, reverse);
+        }
+    }
+
+    int task_error = report_task_error(task, errno);
+    errno = outer_errno;
+
+    if (!task_error) taskpool_spawn(&thread_pool, task->group, export_ordering, task);
+}
+
+/**
+ * @brief Pipeline task writing the lines in their original order.
+ */
+static void copy_text(void* void_task) {
+    PipelineTask* task = (PipelineTask*)void_task;
+    int outer_errno = errno;
+    errno = 0;
+
+    log_printf(STATUS_REPORTS, "status", "Writing the direct copy...\n");
+    {
+        _PROFILE_PHASE_("copy");
+        //* Lines of the text itself are never reordered, so they are already in the original order.
+        if (task->text && !zero_copy) {
+            write_file(task->output_name, task->text->lines, task->text_size, &errno);
+        } else {
+            copy_source(task->output_name, task->source, &errno);
+        }
+    }
+
+    report_task_error(task, errno);
+    errno = outer_errno;
+}
+
+void run_pipeline(const PipelineTask* task, const char* const* output_names, int* error_code) {
+    _LOG_FAIL_CHECK_(task && output_names, "error", ERROR_REPORTS, return;, error_code, EFAULT);
+
+    TaskGroup group = {};
+    std::atomic<int> pipeline_error = {0};
+    PipelineTask tasks[NUMBER_OF_OUTPUTS] = {};
+    for (int output_id = 0; output_id < NUMBER_OF_OUTPUTS; output_id++) {
+        tasks[output_id] = *task;
+        tasks[output_id].output = output_id;
+        tasks[output_id].output_name = output_names[output_id];
+        tasks[output_id].group = &group;
+        tasks[output_id].error_code = &pipeline_error;
+    }
+
+    //* On a single thread tasks run as they are spawned, so outputs are written in this order.
+    taskpool_spawn(&thread_pool, &group, sort_ordering, &tasks[SORTED_OUTPUT]);
+    taskpool_spawn(&thread_pool, &group, sort_ordering, &tasks[RHYMED_OUTPUT]);
+    taskpool_spawn(&thread_pool, &group, copy_text, &tasks[COPY_OUTPUT]);
+    taskpool_wait(&thread_pool, &group);
+
+    if (pipeline_error && error_code) *error_code = pipeline_error;
+}
+
+/**
+ * @brief Check if the name ends with the suffix.
+ */
+static bool has_suffix(const char* name, const char* suffix) {
+    size_t name_length = strlen(name), suffix_length = strlen(suffix);
+    return name_length >= suffix_length && strcmp(name + name_length - suffix_length, suffix) == 0;
+}
+
+/**
+ * @brief Add the file name to the batch.
+ * 
+ * @return bool false if memory could not be allocated
+ */
+static bool add_batch_file(Batch* batch, int* capacity, const char* begin, size_t length) {
+    if (batch->file_count == *capacity) {
+        int new_capacity = *capacity ? *capacity * 2 : 64;
+        char** new_names = (char**)realloc(batch->file_names, new_capacity * sizeof(*new_names));
+        if (!new_names) return false;
+        batch->file_names = new_names;
+        *capacity = new_capacity;
+    }
+
+    char* name = strndup(begin, length);
+    if (!name) return false;
+    batch->file_names[batch->file_count++] = name;
+    return true;
+}
+
+/**
+ * @brief Fill the batch with names of the files listed in the file or lying in the directory.
+ * 
+ * Outputs of previous runs, hidden files and subdirectories of the directory are left out.
+ * 
+ * @param batch_name file with one file name per line or directory
+ * @param batch batch to fill
+ * @param error_code where to put error codes
+ */
+static void collect_batch(const char* batch_name, Batch* batch, int* error_code = NULL) {
+    int capacity = 0;
+
+    struct stat batch_stat = {};
+    _LOG_FAIL_CHECK_(stat(batch_name, &batch_stat) == 0, "error", ERROR_REPORTS, return;, error_code, ENOENT);
+
+    if (!S_ISDIR(batch_stat.st_mode)) {
+        Source list = {};
+        map_file(batch_name, &list, error_code);
+        if (error_code && *error_code) return;
+
+        const char* end = list.data + list.size;
+        for (const char* name = list.data; name < end; ) {
+            const char* name_end = (const char*)memchr(name, '\n', end - name);
+            if (!name_end) name_end = end;
+
+            size_t length = name_end - name;
+            if (length && name[length - 1] == '\r') length--;
+            if (length && !add_batch_file(batch, &capacity, name, length)) {
+                if (error_code) *error_code = ENOMEM;
+                break;
+            }
+
+            name = name_end + 1;
+        }
+
+        unmap_file(&list);
+        return;
+    }
+
+    DIR* directory = opendir(batch_name);
+    _LOG_FAIL_CHECK_(directory, "error", ERROR_REPORTS, return;, error_code, ENOENT);
+
+    char path[MAX_SOURCE_NAME_LENGTH] = "";
+    while (struct dirent* entry = readdir(directory)) {
+        if (entry->d_name[0] == '.') continue;
+
+        bool is_output = false;
+        for (int output_id = 0; output_id < NUMBER_OF_OUTPUTS; output_id++) {
+            is_output = is_output || has_suffix(entry->d_name, BATCH_OUTPUT_SUFFIXES[output_id]);
+        }
+        if (is_output) continue;
+
+        int length = snprintf(path, sizeof(path), "%s/%s", batch_name, entry->d_name);
+        struct stat entry_stat = {};
+        if (length < 0 || (size_t)length >= sizeof(path) || stat(path, &entry_stat) || !S_ISREG(entry_stat.st_mode)) {
+            continue;
+        }
+
+        if (!add_batch_file(batch, &capacity, path, length)) {
+            if (error_code) *error_code = ENOMEM;
+            break;
+        }
+    }
+
+    closedir(directory);
+}
+
+/**
+ * @brief Comparator of C strings for qsort().
+ */
+static int compare_names(const void* a, const void* b) {
+    return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+/**
+ * @brief Read, sort and write a single file of the batch.
+ * 
+ * @param file_name name of the file
+ * @param arena arena of the worker
+ * @return int EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int sort_batch_file(const char* file_name, Arena* arena) {
+    char output_names[NUMBER_OF_OUTPUTS][MAX_SOURCE_NAME_LENGTH] = {};
+    const char* output_pointers[NUMBER_OF_OUTPUTS] = {};
+    for (int output_id = 0; output_id < NUMBER_OF_OUTPUTS; output_id++) {
+        int length = snprintf(output_names[output_id], MAX_SOURCE_NAME_LENGTH, "%s%s",
+                              file_name, BATCH_OUTPUT_SUFFIXES[output_id]);
+        if (length < 0 || (size_t)length >= MAX_SOURCE_NAME_LENGTH) {
+            log_printf(ERROR_REPORTS, "error", "File name %s is too long.\n", file_name);
+            return EXIT_FAILURE;
+        }
+        output_pointers[output_id] = output_names[output_id];
+    }
+
+    log_printf(STATUS_REPORTS, "status", "Reading file %s...\n", file_name);
+
+    Source source = {};
+    int error_code = 0;
+    {
+        _PROFILE_PHASE_("read");
+        map_file(file_name, &source, &error_code);
+    }
+    if (error_code) {
+        log_printf(ERROR_REPORTS, "error", "Failed to read file %s.\n", file_name);
+        return EXIT_FAILURE;
+    }
+
+    int exit_code = sort_utf8_text(&source, output_pointers, arena);
+    unmap_file(&source);
+    arena_reset(arena);
+
+    if (exit_code != EXIT_SUCCESS) log_printf(ERROR_REPORTS, "error", "Failed to sort file %s.\n", file_name);
+    return exit_code;
+}
+
+/**
+ * @brief Task of the batch worker: sort files of the batch until there are none left.
+ * 
+ * @param void_batch batch to sort
+ */
+static void batch_worker(void* void_batch) {
+    Batch* batch = (Batch*)void_batch;
+    Arena arena = {};
+
+    for (int file_id = batch->next_file++; file_id < batch->file_count; file_id = batch->next_file++) {
+        if (sort_batch_file(batch->file_names[file_id], &arena) != EXIT_SUCCESS) batch->failed_count++;
+    }
+
+    arena_destroy(&arena);
+}
+
+int sort_batch(const char* batch_name) {
+    Batch batch = {};
+    collect_batch(batch_name, &batch, &errno);
+
+    if (errno) {
+        log_printf(ERROR_REPORTS, "error", "Failed to list files of batch %s.\n", batch_name);
+    } else {
+        //* Files are taken in a fixed order, so logs of two runs can be compared.
+        qsort(batch.file_names, batch.file_count, sizeof(*batch.file_names), compare_names);
+        log_printf(STATUS_REPORTS, "status", "Batch %s has %d files.\n", batch_name, batch.file_count);
+
+        //* Workers take files one by one, each of them keeps its arena for all files it sorts.
+        int worker_count = thread_count < batch.file_count ? thread_count : batch.file_count;
+        if (worker_count < 1) worker_count = 1;
+
+        TaskGroup workers = {};
+        for (int worker_id = 0; worker_id < worker_count; worker_id++) {
+            taskpool_spawn(&thread_pool, &workers, batch_worker, &batch);
+        }
+        taskpool_wait(&thread_pool, &workers);
+
+        if (batch.failed_count) {
+            log_printf(ERROR_REPORTS, "error", "Failed to sort %d of %d files.\n",
+                       batch.failed_count.load(), batch.file_count);
+        }
+    }
+
+    bool success = !errno && !batch.failed_count;
+
+    for (int file_id = 0; file_id < batch.file_count; file_id++) free(batch.file_names[file_id]);
+    free(batch.file_names);
+
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int build_rhyme_index(const char* index_name) {
+    log_printf(STATUS_REPORTS, "status", "Indexing file %s...\n", text_source_name);
+
+    Source source = {};
+    Arena arena = {};
+    U8line* lines = NULL;
+    int text_size = READING_FAILURE;
+    {
+        _PROFILE_PHASE_("read");
+        if (map_file(text_source_name, &source, &errno) != READING_FAILURE) {
+            text_size = parse_source(&source, &lines, &arena, &errno);
+        }
+    }
+
+    if (text_size != READING_FAILURE) {
+        _PROFILE_PHASE_("resort");
+        char* keys = (char*)arena_alloc(&arena, get_keys_length(lines, text_size), &errno);
+        if (keys && build_keys(lines, text_size, true, keys, &errno)) sort_lines(lines, text_size, &arena);
+    }
+
+    if (text_size != READING_FAILURE && !errno) {
+        _PROFILE_PHASE_("export_index");
+        write_rhyme_index(index_name, &source, lines, text_size, &errno);
+    }
+
+    unmap_file(&source);
+    arena_destroy(&arena);
+
+    if (text_size == READING_FAILURE || errno) {
+        log_printf(ERROR_REPORTS, "error", "Failed to index file %s.\n", text_source_name);
+        return EXIT_FAILURE;
+    }
+
+    log_printf(STATUS_REPORTS, "status", "Saved %d lines into rhyme index %s.\n", text_size, index_name);
+    return EXIT_SUCCESS;
+}
+
+int print_rhymes(const char* index_name, const char* suffix) {
+    RhymeIndex index = {};
+    {
+        _PROFILE_PHASE_("read");
+        if (open_rhyme_index(index_name, &index, &errno) == READING_FAILURE) {
+            log_printf(ERROR_REPORTS, "error", "Failed to open rhyme index %s.\n", index_name);
+            return EXIT_FAILURE;
+        }
+    }
+
+    int first = 0, count = 0;
+    {
+        _PROFILE_PHASE_("lookup");
+        count = find_rhymes(&index, suffix, strlen(suffix), &first, &errno);
+    }
+    log_printf(STATUS_REPORTS, "status", "Found %d lines ending with %s.\n", count, suffix);
+
+    if (top_count > 0 && count > top_count) count = top_count;
+    for (int entry_id = first; entry_id < first + count; entry_id++) {
+        U8line line = get_rhyme(&index, entry_id, &errno);
+        if (errno) break;
+        fwrite(line.sequence, 1, line.length, stdout);
+        fputc('\n', stdout);
+    }
+
+    close_rhyme_index(&index);
+    return errno ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int serve_corpus(const char* socket_name) {
+    log_printf(STATUS_REPORTS, "status", "Loading file %s...\n", text_source_name);
+
+    Source source = {};
+    Arena arena = {};
+    U8line* lines = NULL;
+    int text_size = READING_FAILURE;
+    {
+        _PROFILE_PHASE_("read");
+        if (map_file(text_source_name, &source, &errno) != READING_FAILURE) {
+            text_size = parse_source(&source, &lines, &arena, &errno);
+        }
+    }
+
+    QueryViews views = {};
+    views.length = text_size;
+    views.answer_limit = top_count;
+    views.worker_count = thread_count;
+    if (text_size != READING_FAILURE) {
+        _PROFILE_PHASE_("sort");
+        //* Original lines become the sorted view, their copy the rhymed one.
+        size_t lines_size = text_size * sizeof(*lines);
+        U8line* rhymed = (U8line*)arena_alloc(&arena, lines_size, &errno);
+        char* keys = (char*)arena_alloc(&arena, get_keys_length(lines, text_size), &errno);
+        char* reverse_keys = (char*)arena_alloc(&arena, get_keys_length(lines, text_size), &errno);
+
+        if (rhymed && keys && reverse_keys) {
+            memcpy(rhymed, lines, lines_size);
+            if (build_keys(lines, text_size, false, keys, &errno)) sort_lines(lines, text_size, &arena);
+            if (build_keys(rhymed, text_size, true, reverse_keys, &errno)) sort_lines(rhymed, text_size, &arena);
+        }
+
+        views.sorted = lines;
+        views.rhymed = rhymed;
+    }
+
+    if (text_size != READING_FAILURE && !errno) {
+        _PROFILE_PHASE_("serve");
+        int serve_error = 0;
+        serve_queries(socket_name, &views, &serve_error);
+        //* Stopping signal interrupts system calls, errno they leave is not a failure of the server.
+        errno = serve_error;
+    }
+
+    bool success = text_size != READING_FAILURE && !errno;
+
+    unmap_file(&source);
+    arena_destroy(&arena);
+
+    if (!success) {
+        log_printf(ERROR_REPORTS, "error", "Failed to serve file %s on %s.\n", text_source_name, socket_name);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+void build_view(Text* text, int text_size, TextView* view, bool reverse) {
+    const Charline* lines = text->uniques ? text->uniques : text->lines;
+    int length = text->uniques ? text->groups.unique_count : text_size;
+
+    //* Expanded view is allocated first, so the distinct lines and their keys can be released after the expansion.
+    Charline* expanded = NULL;
+    if (text->uniques && dedup_mode == DEDUP_EXPAND) {
+        expanded = (Charline*)arena_alloc(&text->arena, text_size * sizeof(*expanded), &errno);
+        if (!expanded) return;
+    }
+
+    view->lines_size = length * sizeof(*view->lines);
+    view->lines = (Charline*)arena_alloc(&text->arena, view->lines_size, &errno);
+    if (!view->lines) return;
+    memcpy(view->lines, lines, view->lines_size);
+
+    view->keys_size = get_keys_length(lines, length) * sizeof(*view->keys);
+    wchar_t* keys = (wchar_t*)arena_alloc(&text->arena, view->keys_size, &errno);
+    if (!keys) return;
+
+    view->keys = build_keys(view->lines, length, reverse, keys, &errno);
+    if (!view->keys) return;
+
+    view->length = sort_top_lines(view->lines, length, &text->arena);
+    if (!expanded) return;
+
+    //* Every selected distinct line stands for at least one line, so they are enough for the top of the text.
+    expand_groups(view->lines, view->length, text->lines, &text->groups, expanded, &errno);
+    arena_release(&text->arena, view->keys, view->keys_size);
+    arena_release(&text->arena, view->lines, view->lines_size);
+
+    view->lines = expanded;
+    view->keys = NULL;
+    view->keys_size = 0;
+    view->lines_size = text_size * sizeof(*expanded);
+    view->length = top_count > 0 && top_count < text_size ? top_count : text_size;
+}
+
+void build_view(PipelineTask* task, bool reverse) {
+    const U8line* lines = task->uniques ? task->uniques : task->lines;
+    int length = task->uniques ? task->groups->unique_count : task->text_size;
+
+    U8line* expanded = NULL;
+    if (task->uniques && dedup_mode == DEDUP_EXPAND) {
+        expanded = (U8line*)arena_alloc(task->arena, task->text_size * sizeof(*expanded), &errno);
+        if (!expanded) return;
+    }
+
+    task->view_size = length * sizeof(*task->view);
+    task->view = (U8line*)arena_alloc(task->arena, task->view_size, &errno);
+    if (!task->view) return;
+    memcpy(task->view, lines, task->view_size);
+
+    task->keys_size = get_keys_length(lines, length);
+    task->keys = (char*)arena_alloc(task->arena, task->keys_size, &errno);
+    if (!task->keys) return;
+
+    if (!build_keys(task->view, length, reverse, task->keys, &errno)) return;
+
+    task->view_length = sort_top_lines(task->view, length, task->arena);
+    if (!expanded) return;
+
+    expand_groups(task->view, task->view_length, task->lines, task->groups, expanded, &errno);
+    arena_release(task->arena, task->keys, task->keys_size);
+    arena_release(task->arena, task->view, task->view_size);
+
+    task->view = expanded;
+    task->keys = NULL;
+    task->keys_size = 0;
+    task->view_size = task->text_size * sizeof(*expanded);
+    task->view_length = top_count > 0 && top_count < task->text_size ? top_count : task->text_size;
 }